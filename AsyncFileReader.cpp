@@ -0,0 +1,268 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the AsyncFileReader class.  The ring is driven
+ * with the raw io_uring system calls (see io_uring(7)) so that no
+ * extra library is needed.
+ *
+ */
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include "AsyncFileReader.h"
+
+namespace {
+
+/**
+ * Helper method to map a part of the ring into memory.
+ */
+void* mapRing(const int fd, const size_t size, const uint64_t offset) {
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (mem == MAP_FAILED) ? nullptr : mem;
+}
+
+/**
+ * Helper method to obtain a pointer at an offset into a ring.
+ */
+unsigned* ringField(void* ring, const unsigned offset) {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+}  // namespace
+
+AsyncFileReader::AsyncFileReader(size_t queueDepth, size_t chunkSize,
+                                 bool useUring) :
+    queueDepth(std::max<size_t>(1, queueDepth)),
+    chunkSize(std::max<size_t>(4096, chunkSize)),
+    slots(this->queueDepth) {
+    void* mem = nullptr;
+    if (posix_memalign(&mem, 4096, this->queueDepth * this->chunkSize) != 0) {
+        throw std::runtime_error("Unable to allocate read buffers");
+    }
+    buffers = static_cast<char*>(mem);
+    if (useUring) {
+        setupRing();
+    }
+}
+
+AsyncFileReader::~AsyncFileReader() {
+    closeRing();
+    std::free(buffers);
+}
+
+void AsyncFileReader::setupRing() {
+    io_uring_params params = {};
+    ringFd = syscall(__NR_io_uring_setup, queueDepth, &params);
+    if (ringFd == -1) {
+        return;  // ENOSYS, EPERM (seccomp, io_uring_disabled), ...
+    }
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes +
+        params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+    sqRing = mapRing(ringFd, sqRingSize, IORING_OFF_SQ_RING);
+    cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing :
+        mapRing(ringFd, cqRingSize, IORING_OFF_CQ_RING);
+    sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqeMem = mapRing(ringFd, sqeSize, IORING_OFF_SQES);
+    if (sqRing == nullptr || cqRing == nullptr || sqeMem == nullptr) {
+        closeRing();
+        return;
+    }
+    sqTail  = ringField(sqRing, params.sq_off.tail);
+    sqMask  = ringField(sqRing, params.sq_off.ring_mask);
+    sqArray = ringField(sqRing, params.sq_off.array);
+    cqHead  = ringField(cqRing, params.cq_off.head);
+    cqTail  = ringField(cqRing, params.cq_off.tail);
+    cqMask  = ringField(cqRing, params.cq_off.ring_mask);
+    cqes    = static_cast<char*>(cqRing) + params.cq_off.cqes;
+
+    // Registering the buffers can fail (e.g., RLIMIT_MEMLOCK on older
+    // kernels); plain IORING_OP_READ works without it.
+    std::vector<iovec> iovs(queueDepth);
+    for (size_t i = 0; (i < queueDepth); i++) {
+        iovs[i] = {buffers + i * chunkSize, chunkSize};
+    }
+    fixedBuffers = syscall(__NR_io_uring_register, ringFd,
+                           IORING_REGISTER_BUFFERS, iovs.data(),
+                           iovs.size()) == 0;
+}
+
+void AsyncFileReader::closeRing() {
+    if (sqeMem != nullptr) {
+        munmap(sqeMem, sqeSize);
+    }
+    if (cqRing != nullptr && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != nullptr) {
+        munmap(sqRing, sqRingSize);
+    }
+    sqRing = cqRing = sqeMem = nullptr;
+    if (ringFd != -1) {
+        close(ringFd);
+        ringFd = -1;
+    }
+    fixedBuffers = false;
+}
+
+void AsyncFileReader::readAll(const std::vector<std::string>& paths,
+                              const ChunkHandler& handler) {
+    if (usesUring()) {
+        readUring(paths, handler);
+    } else {
+        readPread(paths, handler);
+    }
+}
+
+void AsyncFileReader::readPread(const std::vector<std::string>& paths,
+                                const ChunkHandler& handler) {
+    for (size_t file = 0; (file < paths.size()); file++) {
+        const int fd = open(paths[file].c_str(), O_RDONLY | O_CLOEXEC);
+        for (off_t offset = 0; fd != -1;) {
+            const ssize_t n = pread(fd, buffers, chunkSize, offset);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            handler(file, buffers, n);
+            offset += n;
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+        handler(file, buffers, 0);
+    }
+}
+
+// The tail is only written by this thread; the release store makes
+// the SQE visible to the kernel before the new tail.
+void AsyncFileReader::queueRead(const size_t slot) {
+    const unsigned tail = *sqTail;
+    const unsigned index = tail & *sqMask;
+    io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqeMem)[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode    = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.fd        = slots[slot].fd;
+    sqe.off       = slots[slot].offset;
+    sqe.addr      = reinterpret_cast<uint64_t>(buffers + slot * chunkSize);
+    sqe.len       = chunkSize;
+    sqe.buf_index = slot;
+    sqe.user_data = slot;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+}
+
+// Each slot holds one open file with one read in flight.  All the
+// reads queued in a round are submitted, and completions waited for,
+// with a single io_uring_enter call.
+void AsyncFileReader::readUring(const std::vector<std::string>& paths,
+                                const ChunkHandler& handler) {
+    std::deque<size_t> freeSlots;
+    for (size_t i = 0; (i < queueDepth); i++) {
+        freeSlots.push_back(i);
+    }
+    size_t next = 0, inFlight = 0;
+    try {
+        readLoop(paths, handler, freeSlots, next, inFlight);
+    } catch (...) {
+        // Let the reads still in flight finish (their buffers must
+        // not be reused before then) and close all the open files.
+        while (inFlight > 0) {
+            const int ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, 1,
+                                    IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (ret == -1 && errno != EINTR) {
+                break;
+            }
+            toSubmit -= (ret > 0) ? std::min<unsigned>(ret, toSubmit) : 0;
+            const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            inFlight -= std::min<size_t>(inFlight, tail - *cqHead);
+            __atomic_store_n(cqHead, tail, __ATOMIC_RELEASE);
+        }
+        for (Slot& s : slots) {
+            if (s.fd != -1) {
+                close(s.fd);
+                s.fd = -1;
+            }
+        }
+        throw;
+    }
+}
+
+void AsyncFileReader::readLoop(const std::vector<std::string>& paths,
+                               const ChunkHandler& handler,
+                               std::deque<size_t>& freeSlots, size_t& next,
+                               size_t& inFlight) {
+    while (next < paths.size() || inFlight > 0) {
+        // Start reading more files while there are free slots.
+        for (; (next < paths.size()) && !freeSlots.empty(); next++) {
+            const int fd = open(paths[next].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                handler(next, buffers, 0);
+                continue;
+            }
+            const size_t slot = freeSlots.front();
+            freeSlots.pop_front();
+            slots[slot] = {fd, next, 0};
+            queueRead(slot);
+            inFlight++;
+        }
+        if (inFlight == 0) {
+            continue;
+        }
+        const int ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, 1,
+                                IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret == -1 && errno != EINTR && errno != EAGAIN &&
+            errno != EBUSY) {
+            throw std::runtime_error("io_uring_enter failed: " +
+                                     std::string(std::strerror(errno)));
+        }
+        if (ret > 0) {
+            toSubmit -= std::min<unsigned>(ret, toSubmit);
+        }
+
+        // Handle all the completions that have arrived.  Each one is
+        // consumed (and no longer counted as in flight) before the
+        // handler is called, in case the handler throws.
+        const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (unsigned head = *cqHead; head != tail;) {
+            const io_uring_cqe cqe =
+                static_cast<io_uring_cqe*>(cqes)[head & *cqMask];
+            __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+            inFlight--;
+            const size_t slot = cqe.user_data;
+            Slot& s = slots[slot];
+            if (cqe.res > 0) {
+                handler(s.file, buffers + slot * chunkSize, cqe.res);
+                s.offset += cqe.res;
+            }
+            if (cqe.res > 0 || cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                queueRead(slot);
+                inFlight++;
+                continue;
+            }
+            // End of file (or an error, which ends the file too)
+            close(s.fd);
+            s.fd = -1;
+            freeSlots.push_back(slot);
+            handler(s.file, buffers + slot * chunkSize, 0);
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef ASYNC_FILE_READER_H
+#define ASYNC_FILE_READER_H
+
+/**
+ * This source file contains the definition for the AsyncFileReader
+ * class.  This class reads many files at once from a single thread:
+ * with io_uring (if the kernel allows it), the reads of all the files
+ * are queued together and their completions are handled as they
+ * arrive, so one slow (uncached) file does not hold up the others.
+ * Without io_uring, the files are read one after another with pread.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <sys/types.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A reader that delivers the contents of many files, in chunks, to a
+ * handler.  The chunks of each file are delivered in order, but the
+ * chunks of different files are interleaved in the order the reads
+ * complete.  With io_uring, the chunk buffers are registered with the
+ * kernel once (fixed buffers), so the reads need no per-call page
+ * pinning.  An object is meant to be reused for many batches.
+ */
+class AsyncFileReader {
+public:
+    /** Called with each chunk of a file: the index of the file (in the
+        list given to readAll), the data, and its length.  A length of
+        zero marks the end of the file.  The data is only valid during
+        the call.
+    */
+    using ChunkHandler = std::function<void(size_t file, const char* data,
+                                            size_t len)>;
+
+    /** The constructor sets up the ring and the buffers.
+
+        \param[in] queueDepth The number of files read at the same time
+        (one chunk in flight per file).
+
+        \param[in] chunkSize The size of each read.
+
+        \param[in] useUring If false (or if io_uring is not available,
+        e.g., it is disabled by a seccomp policy), pread is used.
+    */
+    explicit AsyncFileReader(size_t queueDepth = 32,
+                             size_t chunkSize = 128 * 1024,
+                             bool useUring = true);
+
+    /** The destructor releases the ring and the buffers. */
+    ~AsyncFileReader();
+
+    AsyncFileReader(const AsyncFileReader&) = delete;
+    AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+    /** Read files and pass their contents to a handler.  A file that
+        cannot be opened or read (any further) simply ends, just like
+        an std::ifstream that fails.
+
+        \param[in] paths The files to be read.
+
+        \param[in] handler The handler for the chunks (see
+        ChunkHandler).
+    */
+    void readAll(const std::vector<std::string>& paths,
+                 const ChunkHandler& handler);
+
+    /** Determine if reads go through io_uring (rather than pread).
+
+        \return True if io_uring is in use.
+    */
+    bool usesUring() const { return ringFd != -1; }
+
+    /** Determine if the buffers are registered with the ring.
+
+        \return True if IORING_OP_READ_FIXED reads are used.
+    */
+    bool usesFixedBuffers() const { return fixedBuffers; }
+
+private:
+    /** Set up the ring and register the buffers.  On failure, the
+        ring is released and ringFd is left as -1.
+    */
+    void setupRing();
+
+    /** Release the ring, if any. */
+    void closeRing();
+
+    /** Read the files with io_uring. */
+    void readUring(const std::vector<std::string>& paths,
+                   const ChunkHandler& handler);
+
+    /** Read the files with pread. */
+    void readPread(const std::vector<std::string>& paths,
+                   const ChunkHandler& handler);
+
+    /** The main loop of readUring.  The progress is kept in the
+        caller's variables, so that the caller can clean up if the
+        handler throws.
+    */
+    void readLoop(const std::vector<std::string>& paths,
+                  const ChunkHandler& handler, std::deque<size_t>& freeSlots,
+                  size_t& next, size_t& inFlight);
+
+    /** Queue a read for a slot (without submitting it). */
+    void queueRead(const size_t slot);
+
+    /** The state of one in-flight file. */
+    struct Slot {
+        int fd = -1;
+        size_t file = 0;
+        off_t offset = 0;
+    };
+
+    size_t queueDepth, chunkSize;
+    /** One chunk buffer per slot, page-aligned. */
+    char* buffers = nullptr;
+    std::vector<Slot> slots;
+
+    int ringFd = -1;
+    bool fixedBuffers = false;
+    /** The mapped ring memory and its sizes. */
+    void *sqRing = nullptr, *cqRing = nullptr, *sqeMem = nullptr;
+    size_t sqRingSize = 0, cqRingSize = 0, sqeSize = 0;
+    /** Pointers into the rings. */
+    unsigned *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    void* cqes = nullptr;
+    /** SQEs filled in but not yet submitted. */
+    unsigned toSubmit = 0;
+};
+
+#endif
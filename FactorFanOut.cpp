@@ -0,0 +1,348 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the FactorFanOut class.
+ *
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "FactorFanOut.h"
+
+namespace {
+
+/** Batches sent to a worker whose results have not been merged yet.
+    At least 2 are needed: a worker reads ahead into its next batch
+    and only finishes the older one once that one is complete. */
+const size_t MaxInFlightPerWorker = 4;
+
+/** The coordinator's view of one running worker. */
+struct Worker {
+    ChildProcess proc;
+    /** The coordinator's ends of the worker's stdin and stdout. */
+    int inFd = -1, outFd = -1;
+    /** Numbers waiting to be written to the worker's stdin. */
+    std::string pendingIn;
+    /** Results read from the worker but not yet merged. */
+    std::string out;
+    /** Batches sent but not yet merged. */
+    size_t inFlight = 0;
+};
+
+/** A batch in input order: which worker has it and its size. */
+struct Batch {
+    size_t worker, count;
+};
+
+/**
+ * Helper method to parse a Linux CPU list such as "0-3,8-11".
+ *
+ * \param[in] list The CPU list.
+ *
+ * \return The CPU numbers.
+ */
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream is(list);
+    for (std::string range; std::getline(is, range, ',');) {
+        int lo = 0, hi = 0;
+        const int count = std::sscanf(range.c_str(), "%d-%d", &lo, &hi);
+        for (int cpu = lo; (count >= 1) && (cpu <= (count == 2 ? hi : lo));
+             cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * Helper method to obtain the CPUs this process may run on.
+ *
+ * \return The CPU numbers from the affinity mask.
+ */
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; (cpu < CPU_SETSIZE); cpu++) {
+            if (CPU_ISSET(cpu, &mask)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+/**
+ * Helper method to find the end of the first count lines in a buffer.
+ *
+ * \param[in] buf The buffer to be searched.
+ *
+ * \param[in] count The number of lines.
+ *
+ * \return The number of bytes in the first count lines, or
+ * std::string::npos if the buffer does not have that many lines.
+ */
+size_t linesEnd(const std::string& buf, size_t count) {
+    size_t pos = 0;
+    for (; count > 0; count--) {
+        pos = buf.find('\n', pos);
+        if (pos == std::string::npos) {
+            return pos;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+}  // namespace
+
+FactorFanOut::FactorFanOut(const StrVec& workerCmd, int workers, bool pin) :
+    workerCmd(workerCmd), workers(workers), pin(pin) {
+    if (this->workers <= 0) {
+        this->workers = std::max<int>(1, numaNodes().size());
+    }
+}
+
+std::vector<std::vector<int>> FactorFanOut::numaNodes() {
+    const std::vector<int> allowed = allowedCpus();
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; node++) {
+        std::ifstream in("/sys/devices/system/node/node" +
+                         std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!std::getline(in, list)) {
+            break;
+        }
+        std::vector<int> cpus;
+        for (const int cpu : parseCpuList(list)) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) !=
+                allowed.end()) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            nodes.push_back(cpus);
+        }
+    }
+    return nodes;
+}
+
+std::vector<std::vector<int>> FactorFanOut::cpuSets(const int workers) {
+    const std::vector<std::vector<int>> nodes = numaNodes();
+    std::vector<std::vector<int>> sets(workers);
+    if (nodes.size() > 1) {
+        for (int i = 0; (i < workers); i++) {
+            sets[i] = nodes[i % nodes.size()];
+        }
+        return sets;
+    }
+    const std::vector<int> cpus = allowedCpus();
+    for (int i = 0; (i < workers) && !cpus.empty(); i++) {
+        const size_t start = i * cpus.size() / workers;
+        const size_t end = std::max(start + 1, (i + 1) * cpus.size() / workers);
+        for (size_t c = start; (c < end); c++) {
+            sets[i].push_back(cpus[c % cpus.size()]);
+        }
+    }
+    return sets;
+}
+
+// A single thread drives all the pipes with poll so that the
+// coordinator never blocks writing to a worker that is itself blocked
+// writing results.  Batches go to the least-loaded worker; the order
+// of batches is remembered so the results can be merged in order.
+void FactorFanOut::run(std::istream& is, std::ostream& os,
+                       const size_t batchSize) {
+    std::vector<Worker> pool(workers);
+    const std::vector<std::vector<int>> sets = cpuSets(workers);
+    StrVec cmd = workerCmd;
+    cmd.push_back(std::to_string(batchSize));
+
+    // A worker that dies must not kill us with SIGPIPE.
+    struct sigaction ignore = {}, oldPipe;
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &oldPipe);
+    cpu_set_t oldMask;
+    sched_getaffinity(0, sizeof(oldMask), &oldMask);
+
+    // Workers inherit our affinity when spawned, so pin ourselves to
+    // the worker's CPUs for the spawn.  This way the worker never runs
+    // (or allocates memory) on another node, not even briefly.
+    auto startWorker = [&](size_t i) {
+        int inPipe[2], outPipe[2];
+        if (pipe2(inPipe, O_CLOEXEC) == -1) {
+            return false;
+        }
+        if (pipe2(outPipe, O_CLOEXEC) == -1) {
+            close(inPipe[0]);
+            close(inPipe[1]);
+            return false;
+        }
+        if (pin && !sets[i].empty()) {
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            for (const int cpu : sets[i]) {
+                CPU_SET(cpu, &mask);
+            }
+            sched_setaffinity(0, sizeof(mask), &mask);
+        }
+        StdIo io;
+        io.inFd  = inPipe[0];
+        io.outFd = outPipe[1];
+        const int pid = pool[i].proc.spawn(cmd, io);
+        sched_setaffinity(0, sizeof(oldMask), &oldMask);
+        close(inPipe[0]);
+        close(outPipe[1]);
+        pool[i].inFd  = inPipe[1];
+        pool[i].outFd = outPipe[0];
+        fcntl(pool[i].inFd, F_SETFL, O_NONBLOCK);
+        fcntl(pool[i].outFd, F_SETFL, O_NONBLOCK);
+        return pid > 0;
+    };
+    auto closeFd = [](int& fd) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    };
+    auto finish = [&] {
+        int failed = 0;
+        for (auto& w : pool) {
+            closeFd(w.inFd);
+            closeFd(w.outFd);
+            failed += (w.proc.wait() > 0);
+        }
+        sigaction(SIGPIPE, &oldPipe, nullptr);
+        return failed;
+    };
+
+    bool started = true;
+    for (size_t i = 0; (i < pool.size()); i++) {
+        started = startWorker(i) && started;
+    }
+    if (!started) {
+        finish();
+        throw std::runtime_error("Unable to start worker: " + cmd[0]);
+    }
+
+    std::deque<Batch> order;
+    bool inputDone = false;
+    std::string num;
+    try {
+        while (!inputDone || !order.empty()) {
+            // Merge the batches that are complete, in order.
+            while (!order.empty()) {
+                Worker& w = pool[order.front().worker];
+                const size_t end = linesEnd(w.out, order.front().count);
+                if (end == std::string::npos) {
+                    break;
+                }
+                os.write(w.out.data(), end);
+                w.out.erase(0, end);
+                w.inFlight--;
+                order.pop_front();
+            }
+
+            // Hand out batches while some worker has room.
+            while (!inputDone) {
+                const size_t w = std::min_element(pool.begin(), pool.end(),
+                    [](const Worker& a, const Worker& b) {
+                        return a.inFlight < b.inFlight; }) - pool.begin();
+                if (pool[w].inFlight >= MaxInFlightPerWorker) {
+                    break;
+                }
+                size_t count = 0;
+                for (; (count < batchSize) && (is >> num); count++) {
+                    pool[w].pendingIn += num;
+                    pool[w].pendingIn += '\n';
+                }
+                if (count == 0) {
+                    inputDone = true;
+                    break;
+                }
+                order.push_back({w, count});
+                pool[w].inFlight++;
+            }
+            if (inputDone && order.empty()) {
+                break;
+            }
+
+            // Wait for a pipe to be ready and move data.  At the end of
+            // the input, a worker's stdin is closed so it can finish its
+            // last partial batch.
+            std::vector<pollfd> fds;
+            std::vector<std::pair<size_t, bool>> who;  // worker, is stdin
+            for (size_t i = 0; (i < pool.size()); i++) {
+                if (inputDone && pool[i].pendingIn.empty()) {
+                    closeFd(pool[i].inFd);
+                }
+                if (pool[i].inFd != -1 && !pool[i].pendingIn.empty()) {
+                    fds.push_back({pool[i].inFd, POLLOUT, 0});
+                    who.push_back({i, true});
+                }
+                if (pool[i].outFd != -1) {
+                    fds.push_back({pool[i].outFd, POLLIN, 0});
+                    who.push_back({i, false});
+                }
+            }
+            if (fds.empty() || (poll(fds.data(), fds.size(), -1) == -1 &&
+                                errno != EINTR)) {
+                throw std::runtime_error("Workers stopped before finishing");
+            }
+            for (size_t k = 0; (k < fds.size()); k++) {
+                Worker& w = pool[who[k].first];
+                if (fds[k].revents == 0) {
+                    continue;
+                }
+                if (who[k].second) {
+                    const ssize_t n = write(w.inFd, w.pendingIn.data(),
+                                            w.pendingIn.size());
+                    if (n > 0) {
+                        w.pendingIn.erase(0, n);
+                    } else if (n == -1 && errno != EAGAIN && errno != EINTR) {
+                        throw std::runtime_error("Worker stopped reading");
+                    }
+                } else {
+                    char buf[65536];
+                    const ssize_t n = read(w.outFd, buf, sizeof(buf));
+                    if (n > 0) {
+                        w.out.append(buf, n);
+                    } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                        closeFd(w.outFd);
+                        size_t needed = 0;
+                        for (const Batch& b : order) {
+                            needed += (b.worker == who[k].first) ? b.count : 0;
+                        }
+                        if (linesEnd(w.out, needed) == std::string::npos) {
+                            throw std::runtime_error("Worker exited early");
+                        }
+                    }
+                }
+            }
+        }
+    } catch (...) {
+        for (auto& w : pool) {
+            if (w.proc.getPid() > 0) {
+                kill(w.proc.getPid(), SIGTERM);
+            }
+        }
+        finish();
+        throw;
+    }
+    os.flush();
+    if (finish() != 0) {
+        throw std::runtime_error("Worker exited with an error");
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef FACTOR_FAN_OUT_H
+#define FACTOR_FAN_OUT_H
+
+/**
+ * This source file contains the definition for the FactorFanOut
+ * class.  This class spreads a very large stream of numbers over
+ * several HW05 worker processes (see HW05Worker.cpp) instead of only
+ * the threads of one process.  Separate processes isolate failures and
+ * can each be pinned to one NUMA node, so that their memory is
+ * allocated on the node they run on.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "HW04/ChildProcess.h"
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A coordinator that starts worker processes (using ChildProcess from
+ * HW04), streams batches of numbers to them over pipes, and merges the
+ * results back into input order.  Each worker reads numbers on stdin
+ * and writes exactly one result line per number to stdout, in order.
+ */
+class FactorFanOut {
+public:
+    /** The constructor sets up (but does not start) the workers.
+
+        \param[in] workerCmd The command to run a worker.  The batch
+        size is appended as the last argument.
+
+        \param[in] workers The number of worker processes.  Zero means
+        one per NUMA node (or one if there is a single node).
+
+        \param[in] pin If true, each worker is pinned to the CPUs given
+        by cpuSets.
+    */
+    FactorFanOut(const StrVec& workerCmd, int workers = 0, bool pin = true);
+
+    /** Factorize every number read from a stream using the workers.
+        The workers are started at the beginning and waited for at the
+        end of each call.  A std::runtime_error is thrown if a worker
+        cannot be started or exits before finishing its numbers.
+
+        \param[in] is The input stream from where the numbers are read.
+
+        \param[out] os The output stream to where the results are
+        written, one line per number, in input order.
+
+        \param[in] batchSize The number of numbers sent to a worker at
+        a time.
+    */
+    void run(std::istream& is, std::ostream& os, size_t batchSize = 4096);
+
+    /** Obtain the CPUs that each worker should be pinned to.  With
+        several NUMA nodes (from /sys/devices/system/node) worker i
+        gets all the CPUs of node i % nodes.  Otherwise the CPUs this
+        process may use are divided evenly among the workers.
+
+        \param[in] workers The number of workers.
+
+        \return The CPU numbers for each worker.
+    */
+    static std::vector<std::vector<int>> cpuSets(const int workers);
+
+    /** Obtain the CPUs of each NUMA node that this process may use.
+
+        \return One (non-empty) list of CPU numbers per node; empty if
+        the node information is not available.
+    */
+    static std::vector<std::vector<int>> numaNodes();
+
+private:
+    /** The command (without the batch size) to run a worker. */
+    StrVec workerCmd;
+    /** The number of worker processes. */
+    int workers;
+    /** Pin workers to the CPUs from cpuSets. */
+    bool pin;
+};
+
+#endif
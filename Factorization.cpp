@@ -0,0 +1,217 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation of the Miller-Rabin
+ * primality test and the Pollard-Brent factorization methods declared
+ * in Factorization.h.
+ *
+ */
+
+#include <algorithm>
+#include <numeric>
+#include "Factorization.h"
+#include "PrimeSieve.h"
+
+namespace {
+
+/** Shortcut for the 128-bit type used for intermediate products. */
+using u128 = unsigned __int128;
+
+/** Primes below this bound are removed by trial division (using the
+    primes from the sieve) before using rho. */
+const uint64_t TrialBound = 1 << 12;
+
+/** The primes used to quickly reject composites in isPrime64. */
+const uint64_t SmallPrimes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31,
+                                37, 41, 43, 47, 53, 59, 61, 67, 71, 73,
+                                79, 83, 89, 97};
+
+/**
+ * Arithmetic modulo an odd number n in Montgomery form, i.e., the
+ * value a is represented as a * 2^64 mod n.  Multiplication then needs
+ * only two 64x64 multiplies and no division.
+ */
+class Montgomery {
+public:
+    /** Setup the constants for the given odd modulus. */
+    explicit Montgomery(const uint64_t n) : n(n), nInv(n) {
+        // Newton's iteration doubles the correct low bits each time.
+        for (int i = 0; (i < 5); i++) {
+            nInv *= 2 - n * nInv;
+        }
+        r  = (0 - n) % n;                    // 2^64 mod n
+        r2 = static_cast<uint64_t>(static_cast<u128>(r) * r % n);
+    }
+
+    /** Reduce a 128-bit product; the result is in [0, n). */
+    uint64_t reduce(const u128 t) const {
+        const uint64_t m  = static_cast<uint64_t>(t) * nInv;
+        const uint64_t hi = t >> 64;
+        const uint64_t mn = (static_cast<u128>(m) * n) >> 64;
+        return (hi >= mn) ? hi - mn : hi - mn + n;
+    }
+
+    uint64_t mul(const uint64_t a, const uint64_t b) const {
+        return reduce(static_cast<u128>(a) * b);
+    }
+
+    uint64_t add(const uint64_t a, const uint64_t b) const {
+        const uint64_t s = a + b;
+        return (s >= n || s < a) ? s - n : s;
+    }
+
+    uint64_t toMont(const uint64_t a) const { return mul(a % n, r2); }
+
+    uint64_t one() const { return r; }
+
+    uint64_t pow(uint64_t base, uint64_t exp) const {
+        uint64_t result = r;
+        for (; exp != 0; exp >>= 1) {
+            if (exp & 1) {
+                result = mul(result, base);
+            }
+            base = mul(base, base);
+        }
+        return result;
+    }
+
+    const uint64_t n;
+
+private:
+    uint64_t nInv, r, r2;
+};
+
+/**
+ * Helper method to recursively split n into its prime factors.
+ *
+ * \param[in] n An odd number without small prime factors.
+ *
+ * \param[out] factors The array to which prime factors are added.
+ *
+ * \param[in,out] count The number of entries used in factors.
+ */
+void splitFactors(const uint64_t n, uint64_t* factors, size_t& count) {
+    const PrimeSieve& sieve = PrimeSieve::instance();
+    if (n < sieve.spfBound()) {
+        count += sieve.factor(n, factors + count);  // Table lookups only
+        return;
+    }
+    if (isPrime64(n)) {
+        factors[count++] = n;
+        return;
+    }
+    const uint64_t d = pollardBrent(n);
+    splitFactors(d, factors, count);
+    splitFactors(n / d, factors, count);
+}
+
+}  // namespace
+
+// Deterministic Miller-Rabin.  All arithmetic is done in Montgomery
+// form, so "1" and "n - 1" are compared in that form too.
+bool isPrime64(const uint64_t n) {
+    if (n < 2) {
+        return false;
+    }
+    const PrimeSieve& sieve = PrimeSieve::instance();
+    if (n < sieve.limit()) {
+        return sieve.isPrime(n);
+    }
+    for (const uint64_t p : SmallPrimes) {
+        if (n % p == 0) {
+            return n == p;
+        }
+    }
+    if (n < 97 * 97) {
+        return true;
+    }
+
+    const Montgomery mont(n);
+    const uint64_t one = mont.one(), minusOne = n - one;
+    const int shift = __builtin_ctzll(n - 1);
+    const uint64_t d = (n - 1) >> shift;
+    for (const uint64_t base : {2ULL, 325ULL, 9375ULL, 28178ULL, 450775ULL,
+                                9780504ULL, 1795265022ULL}) {
+        const uint64_t a = base % n;
+        if (a == 0) {
+            continue;
+        }
+        uint64_t x = mont.pow(mont.toMont(a), d);
+        if (x == one || x == minusOne) {
+            continue;
+        }
+        int i = 1;
+        for (; (i < shift) && (x != minusOne); i++) {
+            x = mont.mul(x, x);
+        }
+        if (x != minusOne) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Brent's variant of rho: the sequence y = y^2 + c advances in blocks
+// and the differences are multiplied together so that only one gcd is
+// needed per block.  If a block overshoots (gcd == n) the last block is
+// replayed one step at a time; if that also fails another c is tried.
+uint64_t pollardBrent(const uint64_t n) {
+    const Montgomery mont(n);
+    const uint64_t block = 128;
+    for (uint64_t c = 1;; c++) {
+        const uint64_t mc = mont.toMont(c);
+        auto f = [&](const uint64_t y) { return mont.add(mont.mul(y, y), mc); };
+        uint64_t x = 0, y = mont.toMont(2), ys = y, q = mont.one(), g = 1;
+        for (uint64_t r = 1; g == 1; r <<= 1) {
+            x = y;
+            for (uint64_t i = 0; (i < r); i++) {
+                y = f(y);
+            }
+            for (uint64_t k = 0; (k < r) && (g == 1); k += block) {
+                ys = y;
+                for (uint64_t i = 0; (i < std::min(block, r - k)); i++) {
+                    y = f(y);
+                    q = mont.mul(q, (x > y) ? x - y : y - x);
+                }
+                g = std::gcd(q, n);
+            }
+        }
+        if (g == n) {
+            do {
+                ys = f(ys);
+                g = std::gcd((x > ys) ? x - ys : ys - x, n);
+            } while (g == 1);
+        }
+        if (g != n) {
+            return g;
+        }
+    }
+}
+
+// Numbers covered by the sieve's factor table are answered by lookups.
+// Otherwise small primes are removed by trial division (cheap and
+// common) and the rest is split by rho and checked with Miller-Rabin.
+size_t primeFactors(uint64_t n, uint64_t* factors) {
+    size_t count = 0;
+    if (n < 2) {
+        return count;
+    }
+    const PrimeSieve& sieve = PrimeSieve::instance();
+    static const std::vector<uint32_t> trialPrimes = sieve.primes(TrialBound);
+    for (const uint64_t p : trialPrimes) {
+        if (n < sieve.spfBound()) {
+            break;  // The rest is a table lookup in splitFactors
+        }
+        for (; n % p == 0; n /= p) {
+            factors[count++] = p;
+        }
+    }
+    splitFactors(n, factors, count);
+    std::sort(factors, factors + count);
+    return count;
+}
+
+FactorVec primeFactors(uint64_t n) {
+    uint64_t factors[MaxFactors];
+    return FactorVec(factors, factors + primeFactors(n, factors));
+}
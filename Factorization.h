@@ -0,0 +1,76 @@
+#ifndef FACTORIZATION_H
+#define FACTORIZATION_H
+
+/**
+ * This source file contains the declarations for a fast 64-bit
+ * primality test and integer factorization engine.  Primality is
+ * checked with a deterministic Miller-Rabin test and composites are
+ * split with Pollard-Brent rho.  Both use Montgomery multiplication
+ * (with unsigned __int128 intermediates) to avoid 128-bit divisions.
+ * Numbers small enough for the tables in PrimeSieve are answered by
+ * table lookups instead.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <cstdint>
+#include <vector>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/** A convenience shortcut to a list of 64-bit factors. */
+using FactorVec = std::vector<uint64_t>;
+
+/** The most prime factors a 64-bit number can have (2^64 > 2^63). */
+const size_t MaxFactors = 64;
+
+/**
+ * Determine if a number is prime.  The Miller-Rabin test with the
+ * bases {2, 325, 9375, 28178, 450775, 9780504, 1795265022} is exact
+ * for every 64-bit number.
+ *
+ * \param[in] n The number to be checked.
+ *
+ * \return True if n is prime.
+ */
+bool isPrime64(const uint64_t n);
+
+/**
+ * Find a non-trivial factor of a composite number using Pollard's rho
+ * algorithm with Brent's cycle detection.
+ *
+ * \param[in] n An odd composite number greater than 3.
+ *
+ * \return A factor of n that is neither 1 nor n (not necessarily
+ * prime).
+ */
+uint64_t pollardBrent(const uint64_t n);
+
+/**
+ * Compute the full prime factorization of a number.
+ *
+ * \param[in] n The number to be factorized.
+ *
+ * \return The prime factors of n in ascending order, repeated as per
+ * their multiplicity (e.g., 12 yields {2, 2, 3}).  The list is empty
+ * for 0 and 1.
+ */
+FactorVec primeFactors(uint64_t n);
+
+/**
+ * A variant of primeFactors that does not allocate memory: the factors
+ * are written into a caller-supplied array.
+ *
+ * \param[in] n The number to be factorized.
+ *
+ * \param[out] factors The array to which the prime factors are
+ * written in ascending order.  It must have room for MaxFactors
+ * entries.
+ *
+ * \return The number of factors written (0 for 0 and 1).
+ */
+size_t primeFactors(uint64_t n, uint64_t* factors);
+
+#endif
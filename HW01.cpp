@@ -19,6 +19,8 @@
 #include <iomanip>
 #include <algorithm>
 #include <iterator>
+#include "AsyncFileReader.h"
+#include "Metrics.h"
 
 std::string url_decode(std::string str);
 std::unordered_map<std::string, std::string> processParams(std::string params);
@@ -113,6 +115,8 @@ std::unordered_map<std::string, std::string> processParams(std::string params) {
  * read.
  */
 int max(std::string f) {
+  METRIC_TIMER("hw01_scan_seconds{op=\"max\"}",
+               "Time to read a data file and compute the result.");
   std::ifstream file(f);
   std::istream& in(file);  // Streaming file
 
@@ -138,6 +142,8 @@ int max(std::string f) {
  * read.
  */
 int minVal(std::string f) {
+  METRIC_TIMER("hw01_scan_seconds{op=\"min\"}",
+               "Time to read a data file and compute the result.");
   std::ifstream file(f);
   std::istream& in(file);  // Streaming file
 
@@ -163,21 +169,210 @@ int minVal(std::string f) {
 }
 
 /**
- * The top-level method that is called to process a given input file
- * with data in either HTTP-GET or HTTP-POST format.  This method must
- * generate output in an HTTP-response format using the format strings
- * ResultData and HTTPRespHeader.
+ * An incremental version of max and minVal for data that arrives in
+ * chunks (e.g., from an AsyncFileReader).  It reproduces exactly what
+ * the std::ifstream code does, including its quirks: the header lines
+ * are skipped up to the first empty (or "\r") line, max ignores the
+ * first value, and reading stops at the first token that is not an
+ * int (as operator>> would fail there).
+ */
+class ValueScan {
+ public:
+  /**
+   * The constructor sets up the scan.
+   *
+   * @param min2nd If true compute minVal, otherwise max.
+   */
+  explicit ValueScan(bool min2nd = false) : min2nd(min2nd),
+    larVal(min2nd ? 0 : INT_MIN) {}
+
+  /**
+   * Process the next chunk of the file.
+   *
+   * @param data The chunk.
+   *
+   * @param len The length of the chunk.
+   */
+  void feed(const char* data, size_t len) {
+    for (size_t i = 0; (i < len) && (state != Done); i++) {
+      next(data[i]);
+    }
+  }
+
+  /**
+   * Finish the scan at the end of the file.
+   *
+   * @return The result (the same as max or minVal).
+   */
+  int finish() {
+    if (state == Digits) {
+      emit();
+    }
+    if (state == Sign) {
+      fail(true, 0);  // A lone sign: operator>> stores 0
+    } else if (state != Done) {
+      fail(false, 0);  // End of file: operator>> stores nothing
+    }
+    return min2nd ? secLarVal : larVal;
+  }
+
+ private:
+  /** Where the scan is: in the header lines, between values, after a
+      sign, in the digits of a value, or stopped. */
+  enum State { Header, Space, Sign, Digits, Done };
+
+  void next(const char c) {
+    switch (state) {
+      case Header:
+        if (c == '\n') {
+          state = (lineLen == 0 || (lineLen == 1 && lastChar == '\r')) ?
+            Space : Header;
+          lineLen = 0;
+        } else {
+          lineLen++;
+          lastChar = c;
+        }
+        break;
+      case Digits:
+        if (c >= '0' && c <= '9') {
+          addDigit(c);
+          break;
+        }
+        emit();
+        next(c);  // The character starts the next read
+        break;
+      case Sign:
+        if (c >= '0' && c <= '9') {
+          state = Digits;
+          addDigit(c);
+        } else {
+          fail(true, 0);
+        }
+        break;
+      case Space:
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+          break;
+        }
+        value = 0;
+        negative = (c == '-');
+        if (c == '-' || c == '+') {
+          state = Sign;
+        } else if (c >= '0' && c <= '9') {
+          state = Digits;
+          addDigit(c);
+        } else {
+          fail(true, 0);
+        }
+        break;
+      case Done:
+        break;
+    }
+  }
+
+  void addDigit(const char c) {
+    // Saturate well outside the int range, like strtol does
+    value = std::min<int64_t>(value * 10 + (c - '0'), 1LL << 40);
+  }
+
+  /** A value was read: do what the ifstream loops do with it. */
+  void emit() {
+    const int64_t v = negative ? -value : value;
+    if (v < INT_MIN || v > INT_MAX) {
+      fail(true, v < INT_MIN ? INT_MIN : INT_MAX);
+      return;
+    }
+    state = Space;
+    if (!min2nd) {
+      larVal = (reads > 0 && v > larVal) ? v : larVal;
+    } else if (reads == 0) {
+      larVal = v;
+    } else if (reads == 1) {
+      secLarVal = v;
+      swapPair();
+    } else if (v < larVal) {
+      secLarVal = larVal;
+      larVal = v;
+    } else if (v < secLarVal) {
+      secLarVal = v;
+    }
+    reads++;
+  }
+
+  /**
+   * A read failed, which stops the scan.
+   *
+   * @param stored If operator>> stores a value when it fails this way.
+   *
+   * @param v The value stored.
+   */
+  void fail(const bool stored, const int v) {
+    state = Done;
+    if (min2nd && reads < 2) {
+      if (stored) {
+        (reads == 0 ? larVal : secLarVal) = v;
+      }
+      swapPair();
+    }
+  }
+
+  void swapPair() {
+    if (larVal > secLarVal) {
+      std::swap(larVal, secLarVal);
+    }
+  }
+
+  bool min2nd;
+  State state = Header;
+  size_t lineLen = 0;
+  char lastChar = 0;
+  int64_t value = 0;
+  bool negative = false;
+  size_t reads = 0;
+  int larVal, secLarVal = 0;
+};
+
+/**
+ * A helper method that computes max or minVal for many files at once,
+ * reading all of them from this thread with an AsyncFileReader.  This
+ * is meant for serving many concurrent requests without blocking a
+ * thread on each file.
  *
- * @param is The input stream from where the input data file is to be
- * read.
+ * @param files The data files.
  *
- * @param os The output stream to where the results are to be
- * printed. Note: Do not print to std::cout. Instead, print to this
- * output stream.
+ * @param min2nd For each file, true for minVal and false for max.
+ *
+ * @param reader The reader used for the files.
+ *
+ * @return The result for each file.
  */
-void process(std::istream& is, std::ostream& os) {
-  // Suitably implement this method using helper methods to
-  // structure your logic. Add helper methods *before* this method.
+std::vector<int> computeAll(const std::vector<std::string>& files,
+                            const std::vector<bool>& min2nd,
+                            AsyncFileReader& reader) {
+  std::vector<ValueScan> scans;
+  scans.reserve(files.size());
+  for (size_t i = 0; (i < files.size()); i++) {
+    scans.emplace_back(min2nd[i]);
+  }
+  std::vector<int> results(files.size());
+  reader.readAll(files, [&](size_t file, const char* data, size_t len) {
+    if (len == 0) {
+      results[file] = scans[file].finish();
+    } else {
+      scans[file].feed(data, len);
+    }
+  });
+  return results;
+}
+
+/**
+ * A helper method that reads the parameters of a HTTP-GET or HTTP-POST
+ * request.
+ *
+ * @param is The input stream from where the request is to be read.
+ *
+ * @return The parameters of the request.
+ */
+std::unordered_map<std::string, std::string> requestParams(std::istream& is) {
   std::unordered_map<std::string, std::string> map;
   std::string input;
   is >> input;
@@ -190,25 +385,96 @@ void process(std::istream& is, std::ostream& os) {
     std::string str;
     std::getline(is, str);
     map = processParams(str);
+    METRIC_COUNT("hw01_requests_total{method=\"POST\"}",
+                 "Requests processed.", 1);
   } else if (input == "GET") {
     line = line.substr(line.find('?') + 1, line.length());
     map = processParams(line);
+    METRIC_COUNT("hw01_requests_total{method=\"GET\"}",
+                 "Requests processed.", 1);
   }
+  return map;
+}
 
+/**
+ * A helper method that generates the HTTP response for a request.
+ *
+ * @param map The parameters of the request.
+ *
+ * @param result The result computed for the request.
+ *
+ * @return The response in HTTP-response format.
+ */
+std::string response(std::unordered_map<std::string, std::string>& map,
+                     const int result) {
   // Generating results to be sent back to the client in HTML format.
   auto htmlData = boost::str(boost::format(ResultData) 
   % map["file"] 
   % map["func"]
   % map["type"]
-  % (map["func"] == "min2nd" ? minVal(map["file"]) : max(map["file"])));
+  % result);
   
   // Now that we have HTML data, we can fill-in the content length
   // value in the HTTP response header.
   auto httpRespHdr =
     boost::str(boost::format(HTTPRespHeader) % htmlData.size());
+  return httpRespHdr + htmlData;
+}
+
+/**
+ * A version of process for many requests at once.  The data files of
+ * all the requests are read together from this thread (see
+ * computeAll) instead of one blocking read per request.
+ *
+ * @param requests The requests, each in HTTP-GET or HTTP-POST format.
+ *
+ * @param reader The reader used for the data files.
+ *
+ * @return The response to each request, as process would write it.
+ */
+std::vector<std::string> processAll(const std::vector<std::string>& requests,
+                                    AsyncFileReader& reader) {
+  METRIC_TIMER("hw01_batch_seconds", "Time to process a batch of requests.");
+  std::vector<std::unordered_map<std::string, std::string>> maps;
+  std::vector<std::string> files;
+  std::vector<bool> min2nd;
+  for (const auto& req : requests) {
+    std::istringstream is(req);
+    maps.push_back(requestParams(is));
+    files.push_back(maps.back()["file"]);
+    min2nd.push_back(maps.back()["func"] == "min2nd");
+  }
+  const std::vector<int> results = computeAll(files, min2nd, reader);
+  std::vector<std::string> responses;
+  for (size_t i = 0; (i < maps.size()); i++) {
+    responses.push_back(response(maps[i], results[i]));
+  }
+  return responses;
+}
+
+/**
+ * The top-level method that is called to process a given input file
+ * with data in either HTTP-GET or HTTP-POST format.  This method must
+ * generate output in an HTTP-response format using the format strings
+ * ResultData and HTTPRespHeader.
+ *
+ * @param is The input stream from where the input data file is to be
+ * read.
+ *
+ * @param os The output stream to where the results are to be
+ * printed. Note: Do not print to std::cout. Instead, print to this
+ * output stream.
+ */
+void process(std::istream& is, std::ostream& os) {
+  // Suitably implement this method using helper methods to
+  // structure your logic. Add helper methods *before* this method.
+  METRIC_TIMER("hw01_request_seconds", "Time to process one request.");
+  std::unordered_map<std::string, std::string> map = requestParams(is);
+  const int result =
+    (map["func"] == "min2nd" ? minVal(map["file"]) : max(map["file"]));
 
   // Generate the response in HTTP-response format.
-  os << httpRespHdr << htmlData;
+  os << response(map, result);
 }
 
 // End of source code
@@ -8,8 +8,10 @@
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <iterator>
 #include <numeric>
 #include <unordered_map>
+#include "Metrics.h"
 
 // It is ok to use the following namespace delarations in C++ source
 // files only. They must never be used in header files.
@@ -19,6 +21,12 @@ using namespace std::string_literals;
 std::unordered_map<std::string, std::string> storeUid(std::string f);
 std::unordered_map<std::string, std::string> storeGid(std::string f);
 std::unordered_map<std::string, std::string> storeGroups(std::string f);
+std::vector<const std::string*> lookupAll(
+    const std::unordered_map<std::string, std::string>& map,
+    const std::vector<std::string>& keys);
+std::string expandMembers(
+    const std::unordered_map<std::string, std::string>& uids,
+    std::string members);
 void process(std::istream& is, std::ostream& os);
 
 /**
@@ -29,6 +37,8 @@ void process(std::istream& is, std::ostream& os);
  */
 std::unordered_map<std::string, std::string> storeUid(std::string f) {
     std::unordered_map<std::string, std::string> userInfo;
+    METRIC_TIMER("hw02_load_seconds{map=\"uid\"}",
+                 "Time to load a file into a map.");
     std::ifstream file(f);
     std::string line;
 
@@ -43,6 +53,8 @@ std::unordered_map<std::string, std::string> storeUid(std::string f) {
             break;
         }
     }
+    METRIC_COUNT("hw02_entries_loaded_total{map=\"uid\"}",
+                 "Entries loaded into the maps.", userInfo.size());
     // Return the map of parameters to ease processing them.
     return userInfo;
 }
@@ -55,6 +67,8 @@ std::unordered_map<std::string, std::string> storeUid(std::string f) {
  */
 std::unordered_map<std::string, std::string> storeGid(std::string f) {
     std::unordered_map<std::string, std::string> groupInfo;
+    METRIC_TIMER("hw02_load_seconds{map=\"gid\"}",
+                 "Time to load a file into a map.");
     std::ifstream file(f);
     std::string line;
 
@@ -72,6 +86,8 @@ std::unordered_map<std::string, std::string> storeGid(std::string f) {
             break;
         }
     }
+    METRIC_COUNT("hw02_entries_loaded_total{map=\"gid\"}",
+                 "Entries loaded into the maps.", groupInfo.size());
     // Return the map of parameters to ease processing them.
     return groupInfo;
 }
@@ -84,6 +100,8 @@ std::unordered_map<std::string, std::string> storeGid(std::string f) {
  */
 std::unordered_map<std::string, std::string> storeGroups(std::string f) {
     std::unordered_map<std::string, std::string> groups;
+    METRIC_TIMER("hw02_load_seconds{map=\"groups\"}",
+                 "Time to load a file into a map.");
     std::ifstream file(f);
     std::string line;
 
@@ -102,10 +120,96 @@ std::unordered_map<std::string, std::string> storeGroups(std::string f) {
             break;
         }
     }
+    METRIC_COUNT("hw02_entries_loaded_total{map=\"groups\"}",
+                 "Entries loaded into the maps.", groups.size());
     // Return the map of parameters to ease processing them.
     return groups;
 }
 
+/**
+ * A helper method that looks up many keys in a map at once.  The keys
+ * are handled in groups: first every key in the group is hashed, then
+ * the start of each key's bucket is loaded (and the node there is
+ * prefetched), and only then are the buckets searched.  The cache
+ * misses of the lookups in a group thus overlap rather than being taken
+ * one after another, which matters once the map is much larger than
+ * the CPU caches.
+ * 
+ * @param map The map to be searched.
+ *
+ * @param keys The keys to be looked up.
+ *
+ * @return For each key, a pointer to its value in the map, or nullptr if
+ * the key is not in the map.
+ */
+std::vector<const std::string*> lookupAll(
+    const std::unordered_map<std::string, std::string>& map,
+    const std::vector<std::string>& keys) {
+    constexpr size_t GroupSize = 16;
+    std::vector<const std::string*> values(keys.size(), nullptr);
+    if (map.empty()) {
+        return values;
+    }
+    size_t buckets[GroupSize];
+    std::unordered_map<std::string, std::string>::const_local_iterator
+        nodes[GroupSize];
+    for (size_t start = 0; start < keys.size(); start += GroupSize) {
+        const size_t count = std::min(GroupSize, keys.size() - start);
+        for (size_t i = 0; i < count; i++) {
+            buckets[i] = map.bucket(keys[start + i]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            nodes[i] = map.begin(buckets[i]);
+            if (nodes[i] != map.end(buckets[i])) {
+                __builtin_prefetch(&*nodes[i]);
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            for (auto it = nodes[i]; it != map.end(buckets[i]); it++) {
+                if (it->first == keys[start + i]) {
+                    values[start + i] = &it->second;
+                    break;
+                }
+            }
+        }
+    }
+    return values;
+}
+
+/**
+ * A helper method that lists the members of a group with their login
+ * IDs, e.g., " user1(1000) user2(1001)".  Unknown uids are listed with
+ * an empty login ID.  The uids are looked up all at once (see
+ * lookupAll).
+ * 
+ * @param uids The map from uid to login ID (see storeUid).
+ *
+ * @param members The comma-separated uids of the members.
+ *
+ * @return The members, each preceded by a space.
+ */
+std::string expandMembers(
+    const std::unordered_map<std::string, std::string>& uids,
+    std::string members) {
+    std::replace(members.begin(), members.end(), ',', ' ');
+    std::istringstream iss(members);
+    const std::vector<std::string> keys{
+        std::istream_iterator<std::string>(iss),
+        std::istream_iterator<std::string>()};
+    const std::vector<const std::string*> logins = lookupAll(uids, keys);
+
+    std::string ret;
+    for (size_t i = 0; i < keys.size(); i++) {
+        ret += " ";
+        if (logins[i] != nullptr) {
+            ret += *logins[i];
+        }
+        ret += "(" + keys[i] + ")";
+    }
+    METRIC_COUNT("hw02_members_total", "Group members listed.", keys.size());
+    return ret;
+}
+
 /**
  * A helper method that stores information all the necessary information
  * into an unordered map. Then forms an output using those information.
@@ -121,26 +225,20 @@ std::string result(std::string in) {
     map1 = storeUid("passwd");
     map2 = storeGid("groups");
     map3 = storeGroups("groups");
+    METRIC_TIMER("hw02_lookup_seconds", "Time to look up a group.");
+    METRIC_COUNT("hw02_lookups_total", "Group lookups.", 1);
 
     // checking if the input key exists
     if (map3.find(in) == map3.end()) {
+        METRIC_COUNT("hw02_groups_not_found_total", "Unknown groups.", 1);
         return in + " = Group not found.";
     } else {
         try {
             ret = in + " = " + map3[in] + ":";
             
-            // Taking in all the user associated with the groupId
-            string users = map2[in];
-            std::replace(users.begin(), users.end(), ',', ' ');
-            istringstream iss(users);
-
-            // Reading string word-by-word to identify group members associated
-            // with the uid
-            string sub;
-            while (iss >> sub) {
-                ret += " ";
-                ret += (map1[sub] + "(" + sub + ")");
-            }
+            // Taking in all the user associated with the groupId and
+            // identifying them by their uid
+            ret += expandMembers(map1, map2[in]);
         } catch (...) {}
     }
     return ret;
@@ -12,6 +12,10 @@
  *      attempted to login more than 3 times in a span of 20 seconds
  */
 
+#include <unistd.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -21,6 +25,7 @@
 #include <stdexcept>
 #include <algorithm>
 #include <boost/asio.hpp>
+#include "Metrics.h"
 
 // Convenience namespace declarations to streamline the code below
 using namespace boost::asio;
@@ -44,6 +49,152 @@ using LookupMap = std::unordered_map<std::string, bool>;
  */
 using LoginTimes = std::unordered_map<std::string, std::vector<long>>;
 
+/**
+ * The state of the detector in process, saved in checkpoints so that
+ * an interrupted run over a long log can resume where it stopped.
+ */
+struct DetectorState {
+    /** The bytes of input consumed, including the HTTP header. */
+    uint64_t offset = 0;
+    /** The lines processed and the hacking attempts found. */
+    uint64_t lineCount = 0, hackCount = 0;
+    /** The number of consecutive failed logins so far. */
+    uint64_t failCount = 0;
+    /** The length and hash of the last line processed, used to check
+        that a resumed run reads the same input. */
+    uint64_t lastLineLen = 0, lastLineHash = 0;
+};
+
+/**
+ * Options for checkpointing in process.  By default no checkpoints are
+ * written.
+ */
+struct CheckpointOptions {
+    /** The checkpoint file, empty for no checkpoints. */
+    std::string path;
+    /** Write a checkpoint after this many lines. */
+    uint64_t everyLines = 1000000;
+    /** Resume from the checkpoint file, if it exists. */
+    bool resume = false;
+};
+
+/**
+ * The on-disk format of a checkpoint: a fixed-size record in the
+ * byte order of the machine, ending with a checksum of the rest.
+ */
+struct CheckpointRecord {
+    char magic[4];
+    uint32_t version;
+    DetectorState state;
+    uint64_t checksum;
+};
+
+/** The magic number and version of CheckpointRecord. */
+const char CheckpointMagic[4] = {'H', 'W', '3', 'C'};
+const uint32_t CheckpointVersion = 1;
+
+/**
+ * Helper method to compute the 64-bit FNV-1a hash of some bytes.
+ *
+ * @param data The bytes to be hashed.
+ *
+ * @param len The number of bytes.
+ *
+ * @param hash The hash to continue from.
+ *
+ * @return The hash.
+ */
+uint64_t fnv1a(const void* data, const size_t len,
+               uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; (i < len); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Helper method to write a checkpoint.  The record is written to a
+ * temporary file, synced, and renamed over the checkpoint, so a crash
+ * leaves either the old or the new checkpoint.
+ *
+ * @param path The checkpoint file.
+ *
+ * @param state The state to be saved.
+ */
+void saveCheckpoint(const std::string& path, const DetectorState& state) {
+    CheckpointRecord rec = {};
+    std::copy(CheckpointMagic, CheckpointMagic + 4, rec.magic);
+    rec.version  = CheckpointVersion;
+    rec.state    = state;
+    rec.checksum = fnv1a(&rec, offsetof(CheckpointRecord, checksum));
+    const std::string tmpPath = path + ".tmp";
+    FILE* fp = std::fopen(tmpPath.c_str(), "wb");
+    const bool ok = (fp != nullptr) &&
+        std::fwrite(&rec, sizeof(rec), 1, fp) == 1 &&
+        std::fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fp != nullptr) {
+        std::fclose(fp);
+    }
+    if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Error writing checkpoint " + path);
+    }
+}
+
+/**
+ * Helper method to read a checkpoint.
+ *
+ * @param path The checkpoint file.
+ *
+ * @param state The state to be restored.
+ *
+ * @return False if there is no checkpoint file.  A corrupt checkpoint
+ * results in an exception.
+ */
+bool loadCheckpoint(const std::string& path, DetectorState& state) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is.good()) {
+        return false;
+    }
+    CheckpointRecord rec;
+    if (!is.read(reinterpret_cast<char*>(&rec), sizeof(rec)) ||
+        !std::equal(CheckpointMagic, CheckpointMagic + 4, rec.magic) ||
+        rec.version != CheckpointVersion ||
+        rec.checksum != fnv1a(&rec, offsetof(CheckpointRecord, checksum))) {
+        throw std::runtime_error("Invalid checkpoint " + path);
+    }
+    state = rec.state;
+    return true;
+}
+
+/**
+ * Helper method to position a stream just after the input covered by
+ * a checkpoint.  Seekable streams (files) seek directly; others (e.g.,
+ * downloads) skip the bytes.  The last line before that position must
+ * be the line the checkpoint was taken after.
+ *
+ * @param is The input stream.
+ *
+ * @param state The restored state.
+ */
+void skipTo(std::istream& is, const DetectorState& state) {
+    const uint64_t lineStart = state.offset - state.lastLineLen - 1;
+    if (!is.seekg(lineStart)) {
+        is.clear();
+        for (uint64_t left = lineStart; (left > 0) && is;) {
+            const uint64_t chunk = std::min<uint64_t>(left, 1 << 30);
+            is.ignore(chunk);
+            left -= chunk;
+        }
+    }
+    std::string line;
+    std::getline(is, line);
+    if (line.size() != state.lastLineLen ||
+        fnv1a(line.data(), line.size()) != state.lastLineHash) {
+        throw std::runtime_error("Checkpoint does not match the input");
+    }
+}
+
 /**
  * Helper method to load data from a given file into an unordered map.
  * 
@@ -128,19 +279,34 @@ void setupDownload(const std::string& hostName, const std::string& path,
  *
  * @param os The output stream to where the results are to be
  * printed.
+ *
+ * @param ckpt Where and how often to save checkpoints, and whether to
+ * resume from one.  When resuming, the hacking attempts found after
+ * the checkpoint (but before the interruption) are reported again.
  */
-void process(std::istream& is, std::ostream& os) {
+void process(std::istream& is, std::ostream& os,
+             const CheckpointOptions& ckpt = CheckpointOptions()) {
     LookupMap goodUsers = loadLookup("authorized_users.txt");
     LookupMap bannedIps = loadLookup("banned_ips.txt");
-    int lineCount = 0, hackCount = 0, failCount = 0;
+    DetectorState st;
 
-    // Skipping to the bottom of the web-server
-    for (std::string hdr; std::getline(is, hdr) && !hdr.empty() && hdr != "\r";)
-    {}
+    if (ckpt.resume && !ckpt.path.empty() && loadCheckpoint(ckpt.path, st)) {
+        skipTo(is, st);
+    } else {
+        // Skipping to the bottom of the web-server
+        for (std::string hdr; std::getline(is, hdr);) {
+            st.offset += hdr.size() + 1;
+            if (hdr.empty() || hdr == "\r") {
+                break;
+            }
+        }
+    }
     for (std::string line; std::getline(is, line);) {
         // Instead of printing lines, do the necessary processing to
         // detect malicious logins
-        lineCount++;
+        st.lineCount++;
+        METRIC_TIMER("hw03_line_seconds", "Time to parse and check a line.");
+        METRIC_COUNT("hw03_lines_total", "Log lines processed.", 1);
 
         // Reading through each criteria of the line
         std::string month, day, time, user, ip, status;
@@ -149,22 +315,37 @@ void process(std::istream& is, std::ostream& os) {
         std::string tempStatus = status;
 
         // Counting for repeated failed login attempts
-        failCount = (status == "Failed" && status == tempStatus) ?
-        failCount + 1 : 0;
+        st.failCount = (status == "Failed" && status == tempStatus) ?
+        st.failCount + 1 : 0;
 
-        if (failCount >= 3) {
-            hackCount++;
+        if (st.failCount >= 3) {
+            st.hackCount++;
+            METRIC_COUNT("hw03_hacks_total{reason=\"frequency\"}",
+                         "Possible hacking attempts found.", 1);
             std::cout << "Hacking due to frequency. Line: " << line << '\n';
         }
 
         // Checking in the unordered map if the current ip is a banned ip
         if (bannedIps[ip]) {
-            hackCount++;
+            st.hackCount++;
+            METRIC_COUNT("hw03_hacks_total{reason=\"banned_ip\"}",
+                         "Possible hacking attempts found.", 1);
             std::cout << "Hacking due to banned IP. Line: " << line << '\n';
         }
+
+        st.offset += line.size() + 1;
+        if (!ckpt.path.empty() && (ckpt.everyLines > 0) &&
+            (st.lineCount % ckpt.everyLines == 0)) {
+            // Everything reported so far must be out before the
+            // checkpoint says it was done.
+            st.lastLineLen  = line.size();
+            st.lastLineHash = fnv1a(line.data(), line.size());
+            std::cout.flush();
+            saveCheckpoint(ckpt.path, st);
+        }
     }
-    std::cout << "Processed " << lineCount << " lines. Found " << hackCount
-    << " possible hacking attempts.\n";
+    std::cout << "Processed " << st.lineCount << " lines. Found "
+    << st.hackCount << " possible hacking attempts.\n";
 }
 
 /**
@@ -172,9 +353,14 @@ void process(std::istream& is, std::ostream& os) {
  * log entries from the given URL and detect potential hacking attempts.
  *
  * \param[in] argc The number of command-line arguments.  This program
- * requires exactly one command-line argument.
+ * requires at least one command-line argument.
  *
- * \param[in] argv The actual command-line argument. This should be an URL.
+ * \param[in] argv The actual command-line arguments.  The first should
+ * be an URL, or the path of a local log file (in the same HTTP-response
+ * format) for backfills over saved logs.  The options that may follow
+ * are "--checkpoint <file>" to save checkpoints, "--every <lines>" to
+ * set how often (default: 1000000 lines), and "--resume" to continue
+ * from the checkpoint of an interrupted run.
  */
 int main(int argc, char *argv[]) {
     if (argc < 2) {
@@ -183,6 +369,31 @@ int main(int argc, char *argv[]) {
     }
     // Store the URL as a string to make processing easier.
     const std::string url = argv[1];
+    CheckpointOptions ckpt;
+    for (int i = 2; (i < argc); i++) {
+        const std::string opt = argv[i];
+        if (opt == "--resume") {
+            ckpt.resume = true;
+        } else if (opt == "--checkpoint" && i + 1 < argc) {
+            ckpt.path = argv[++i];
+        } else if (opt == "--every" && i + 1 < argc) {
+            ckpt.everyLines = std::stoull(argv[++i]);
+        } else {
+            std::cout << "Unknown option " << opt << '\n';
+            return 1;
+        }
+    }
+    if (url.find("://") == std::string::npos) {
+        // A saved log: seekable, so a resume skips straight to the
+        // checkpoint.
+        std::ifstream is(url);
+        if (!is.good()) {
+            std::cout << "Unable to open " << url << '\n';
+            return 1;
+        }
+        process(is, cout, ckpt);
+        return 0;
+    }
     std::string delim1 = "//";
     std::string delim = "edu";
     std::string host = url.substr(url.find(delim1) + 2, url.find(delim) +
@@ -197,7 +408,7 @@ int main(int argc, char *argv[]) {
     setupDownload(host, path, is);
 
     // Calling the process method to output the results from the web-server
-    process(is, cout);
+    process(is, cout, ckpt);
 
     // All done. Successful finish should return zero.
     return 0;
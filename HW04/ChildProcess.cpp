@@ -11,10 +11,17 @@
 
 // All the necessary #includes are already here
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <cerrno>
+#include <string>
 #include <stdexcept>
 #include <vector>
 #include "ChildProcess.h"
+#include "../Metrics.h"
 
 /** NOTE: Unlike Java, C++ does not require class names and file names
  * should match.  Hence when defining methods pertaining to a specific
@@ -24,16 +31,29 @@
  * "ChildProces::method" (and not just "method")
  */
 
-// This method is just a copy-paste from lecture notes. This is done
-// to illustrate an example.
-void
-ChildProcess::myExec(StrVec argList) {
+// The environment of this process, passed on to spawned children.
+extern char **environ;
+
+// Build the argv array once, directly from the caller's strings.
+// execvp and posix_spawnp never modify the arguments, so pointing at
+// the (const) strings avoids copying the whole argument list.
+std::vector<char*>
+ChildProcess::makeArgv(const StrVec& argList) {
     std::vector<char*> args;    // list of pointers to args
-    for (auto& s : argList) {
-        args.push_back(&s[0]);  // address of 1st character
+    args.reserve(argList.size() + 1);
+    for (const auto& s : argList) {
+        args.push_back(const_cast<char*>(s.c_str()));
     }
     // nullptr is very important
     args.push_back(nullptr);
+    return args;
+}
+
+// This method is adapted from lecture notes. This is done
+// to illustrate an example.
+void
+ChildProcess::myExec(const StrVec& argList) {
+    std::vector<char*> args = makeArgv(argList);
     // Make execvp system call to run desired process
     execvp(args[0], &args[0]);
     // In case execvp ever fails, we throw a runtime execption
@@ -49,21 +69,175 @@ ChildProcess::~ChildProcess() { }
 // This is a relatively simple method with an if-statement to call
 // myExec in the child process and just return the childPid in parent.
 int ChildProcess::forkNexec(const StrVec& strVec) {
+    usage = ChildUsage();
+    startTime = std::chrono::steady_clock::now();
     childPid = fork();
     if (childPid == 0) {
         myExec(strVec);
     }
+    METRIC_RECORD("hw04_spawn_seconds", "Time to start a child process.",
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - startTime).count());
+    METRIC_COUNT("hw04_spawns_total", "Child processes started.", 1);
 
     return childPid;
 }
 
-// Use the comments in the header to implement the wait method.  This
-// is a relatively simple method which uses waitpid call to get
-// exitCode.  This is a short 3-line method.
-int ChildProcess::wait() const {
-    int exitCode = 0;
-    waitpid(childPid, &exitCode, 0);
-    return exitCode;
+// Spawn the child with only file redirections.
+int ChildProcess::spawn(const StrVec& argList, const std::string& inFile,
+                        const std::string& outFile) {
+    StdIo io;
+    io.inFile  = inFile;
+    io.outFile = outFile;
+    return spawn(argList, io);
+}
+
+// Spawn the child without duplicating this process's address space.
+// Optional redirections are applied in the child by posix_spawn.
+int ChildProcess::spawn(const StrVec& argList, const StdIo& io) {
+    METRIC_TIMER("hw04_spawn_seconds", "Time to start a child process.");
+    childPid = -1;
+    usage = ChildUsage();
+    startTime = std::chrono::steady_clock::now();
+    if (argList.empty()) {
+        errno = EINVAL;
+        return childPid;
+    }
+    std::vector<char*> args = makeArgv(argList);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (!io.inFile.empty()) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,
+                                         io.inFile.c_str(), O_RDONLY, 0);
+    } else if (io.inFd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, io.inFd, STDIN_FILENO);
+    }
+    if (!io.outFile.empty()) {
+        const int mode = O_WRONLY | O_CREAT | (io.append ? O_APPEND : O_TRUNC);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                         io.outFile.c_str(), mode, 0644);
+    } else if (io.outFd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, io.outFd, STDOUT_FILENO);
+    }
+    if (io.errFd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, io.errFd, STDERR_FILENO);
+    }
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_USEVFORK
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK);
+#endif
+
+    pid_t pid = -1;
+    const int err = posix_spawnp(&pid, args[0], &actions, &attr,
+                                 args.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        METRIC_COUNT("hw04_spawn_failures_total",
+                     "Child processes that could not be started.", 1);
+        errno = err;
+        return childPid;
+    }
+    METRIC_COUNT("hw04_spawns_total", "Child processes started.", 1);
+    childPid = pid;
+    return childPid;
+}
+
+// Use the comments in the header to implement the wait method.  The
+// wait4 call gives both the exit status and the child's resource usage.
+int ChildProcess::wait() {
+    if (childPid == -1) {
+        return -1;  // No child (e.g., spawn failed), nothing to wait on
+    }
+    METRIC_TIMER("hw04_wait_seconds", "Time blocked waiting for a child.");
+    int status = 0;
+    struct rusage ru = {};
+    while (wait4(childPid, &status, 0, &ru) == -1 && errno == EINTR) {}
+    ChildUsage childUsage;
+    fillUsage(status, ru, childUsage);
+    setUsage(childUsage);
+    return usage.exitCode;
+}
+
+// Record the usage and compute the wall time since the child started.
+void ChildProcess::setUsage(const ChildUsage& childUsage) {
+    usage = childUsage;
+    usage.wallMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - startTime).count();
+    METRIC_RECORD("hw04_child_seconds", "Wall time of a child process.",
+                  static_cast<uint64_t>(usage.wallMs * 1e6));
+}
+
+// Return the usage recorded by wait or setUsage.
+const ChildUsage& ChildProcess::getUsage() const {
+    return usage;
+}
+
+// Decode the raw status the same way a shell reports it in $?
+int ChildProcess::decodeStatus(const int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return status;
+}
+
+// Copy the interesting rusage fields, converting times to milliseconds.
+void ChildProcess::fillUsage(const int status, const rusage& ru,
+                             ChildUsage& usage) {
+    auto toMs = [](const struct timeval& tv) {
+        return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+    };
+    usage.exitCode       = decodeStatus(status);
+    if (usage.exitCode == 0) {
+        METRIC_COUNT("hw04_exits_total{status=\"ok\"}",
+                     "Child processes waited for.", 1);
+    } else {
+        METRIC_COUNT("hw04_exits_total{status=\"error\"}",
+                     "Child processes waited for.", 1);
+    }
+    usage.userMs         = toMs(ru.ru_utime);
+    usage.sysMs          = toMs(ru.ru_stime);
+    usage.maxRssKb       = ru.ru_maxrss;
+    usage.minorFaults    = ru.ru_minflt;
+    usage.majorFaults    = ru.ru_majflt;
+    usage.volCtxSwitches = ru.ru_nvcsw;
+    usage.invCtxSwitches = ru.ru_nivcsw;
+}
+
+// Return the PID stored by the forkNexec method.
+int ChildProcess::getPid() const {
+    return childPid;
+}
+
+// Wait for any child to finish.  Interrupted calls are retried so
+// that a stray signal does not look like "no more children".
+int ChildProcess::waitAny(ChildUsage& usage) {
+    METRIC_TIMER("hw04_wait_seconds", "Time blocked waiting for a child.");
+    int pid = -1, status = 0;
+    struct rusage ru = {};
+    do {
+        pid = wait4(-1, &status, 0, &ru);
+    } while (pid == -1 && errno == EINTR);
+    usage = ChildUsage();
+    if (pid != -1) {
+        fillUsage(status, ru, usage);
+    }
+    return pid;
+}
+
+int ChildProcess::openPidFd(const int pid) {
+#ifdef __NR_pidfd_open
+    return syscall(__NR_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
 }
 
 #endif
@@ -9,12 +9,64 @@
  * Copyright (C) 2020 raodm@miamiOH.edu
  */
 
+#include <chrono>
 #include <string>
 #include <vector>
 
 // A convenience shortcut to a vector-of-strings
 using StrVec = std::vector<std::string>;
 
+// Forward declaration for the structure filled in by wait4 (from
+// sys/resource.h) to avoid including system headers here.
+struct rusage;
+
+/**
+ * Where the standard input and standard output of a child process
+ * started by ChildProcess::spawn come from and go to.  A file name
+ * takes precedence over a file descriptor.  When neither is given the
+ * child shares the stream with this process.
+ */
+struct StdIo {
+    /** A descriptor (e.g., the read end of a pipe) to use as stdin. */
+    int inFd = -1;
+    /** A file to be opened (read-only) as stdin. */
+    std::string inFile;
+    /** A descriptor (e.g., the write end of a pipe) to use as stdout. */
+    int outFd = -1;
+    /** A file to be created (or truncated) as stdout. */
+    std::string outFile;
+    /** Append to outFile (">>") instead of truncating it (">"). */
+    bool append = false;
+    /** A descriptor (e.g., a file capturing output) to use as stderr. */
+    int errFd = -1;
+};
+
+/**
+ * The resources used by a child process that has finished.  The
+ * values (other than wallMs) are obtained from the rusage structure
+ * filled in by the wait4 system call.
+ */
+struct ChildUsage {
+    /** The decoded exit code (see ChildProcess::decodeStatus). */
+    int exitCode = -1;
+    /** Elapsed (wall-clock) time from start to reaping, in ms. */
+    double wallMs = 0;
+    /** CPU time spent in user mode, in ms. */
+    double userMs = 0;
+    /** CPU time spent in the kernel on behalf of the child, in ms. */
+    double sysMs = 0;
+    /** Maximum resident set size, in kilobytes. */
+    long maxRssKb = 0;
+    /** Page faults serviced without any I/O. */
+    long minorFaults = 0;
+    /** Page faults that required I/O. */
+    long majorFaults = 0;
+    /** Voluntary context switches (e.g., blocking on I/O). */
+    long volCtxSwitches = 0;
+    /** Involuntary context switches (e.g., time slice expired). */
+    long invCtxSwitches = 0;
+};
+
 // ------------------------------------------------------------------- //
 // ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
 // ------------------------------------------------------------------- //
@@ -56,34 +108,164 @@ public:
     */
     int forkNexec(const StrVec& argList);
 
+    /** A faster alternative to forkNexec that uses the posix_spawnp
+        library call.  On Linux, posix_spawnp creates the child with
+        clone(CLONE_VM|CLONE_VFORK) so the parent's page tables are
+        not copied, which keeps the cost of starting a program low
+        even when this process has grown large.
+
+        \param[in] argList The list of command-line arguments.  The
+        first entry is assumed to be the command to be executed.
+
+        \param[in] inFile An optional file to be used as the standard
+        input of the child.  An empty string leaves stdin unchanged.
+
+        \param[in] outFile An optional file (created or truncated) to
+        be used as the standard output of the child.  An empty string
+        leaves stdout unchanged.
+
+        \return This method returns the pid value of the child process
+        or -1 if the program could not be started (errno is set).
+    */
+    int spawn(const StrVec& argList, const std::string& inFile = "",
+              const std::string& outFile = "");
+
+    /** A variant of spawn that redirects stdin and stdout as
+        described by io.  The descriptors in io are duplicated onto
+        stdin/stdout of the child; the caller remains responsible for
+        closing its own copies (ideally opened with O_CLOEXEC so that
+        other children do not inherit them).
+
+        \param[in] argList The list of command-line arguments.  The
+        first entry is assumed to be the command to be executed.
+
+        \param[in] io The redirections to be applied in the child.
+
+        \return This method returns the pid value of the child process
+        or -1 if the program could not be started (errno is set).
+    */
+    int spawn(const StrVec& argList, const StdIo& io);
+
     /** Helper method to wait for child process to finish.  This
-        method calls the waitpid system call. It obtains the exit code
-        of the child process from the 2nd argument of the waitpid
-        system call.
+        method calls the wait4 system call. It obtains the exit code
+        of the child process from the 2nd argument of the wait4
+        system call and the resources used by the child from the 4th
+        argument.  The resource usage is then available via getUsage.
+
+        \return This method returns the decoded exit code of the child
+        process or -1 if there is no child process to wait for.
+    */
+    int wait();
+
+    /** Record the status and resource usage of the child process
+        after it has been reaped by waitAny.  The wall time is computed
+        from the time the child was started.
 
-        \return This method returns the exit code of the child
-        process.
+        \param[in] usage The usage obtained from waitAny.
     */
-    int wait() const;
+    void setUsage(const ChildUsage& usage);
+
+    /** Obtain the resources used by the child process.  The values
+        are only meaningful after the child has been waited on.
+
+        \return The resource usage of the child process.
+    */
+    const ChildUsage& getUsage() const;
+
+    /** Convert a raw status value from the wait family of system
+        calls into an exit code.  Programs that exit normally yield
+        their exit status (WEXITSTATUS).  Programs killed by a signal
+        yield 128 + signal number, as in bash.
+
+        \param[in] status The raw status value.
+
+        \return The decoded exit code.
+    */
+    static int decodeStatus(const int status);
+
+    /** Obtain the PID of the child process most recently forked by
+        this object.
+
+        \return The PID of the child process or -1 if no child process
+        has been forked yet.
+    */
+    int getPid() const;
+
+    /** Helper method to wait for whichever child process (of the
+        calling process) finishes first.  This method calls the
+        wait4 system call with -1 as the PID.  It is used to reap
+        children in the order in which they finish rather than the
+        order in which they were started.
+
+        \param[out] usage The decoded exit code and resource usage of
+        the child process that finished.  The wall time is not known
+        here; pass usage to setUsage on the matching object.
+
+        \return The PID of the child process that finished or -1 if
+        there are no child processes to wait for.
+    */
+    static int waitAny(ChildUsage& usage);
+
+    /** Open a pidfd for a child process: a descriptor that poll
+        reports as readable once the child has exited, so waiting for
+        children can be combined with waiting for other descriptors.
+        The child is not reaped; the caller closes the descriptor.
+
+        \param[in] pid The PID of the child process.
+
+        \return The descriptor, or -1 if it could not be opened (e.g.,
+        the kernel is older than Linux 5.3).
+    */
+    static int openPidFd(const int pid);
     
 protected:
     /** A helper method to setup pointers and call execvp system call.
         This method should be called from a child process.  Don't call
         this method directly.  Instead, call the forkNexec API method.
 
-        NOTE: This method is a copy-paste from the lecture slides.
+        NOTE: This method is adapted from the lecture slides.
         
         \param[in] argList The list of command-line arguments.  The
         first entry is assumed to be the command to be executed.
     */
-    void myExec(StrVec argList);
+    void myExec(const StrVec& argList);
+
+    /** Helper method to build the nullptr-terminated argument array
+        expected by execvp and posix_spawnp.  The pointers refer to the
+        strings in argList, so argList must outlive the returned
+        vector.
+
+        \param[in] argList The list of command-line arguments.
+
+        \return The list of pointers to the arguments, with a trailing
+        nullptr.
+    */
+    static std::vector<char*> makeArgv(const StrVec& argList);
+
+    /** Helper method to copy the fields of interest from the rusage
+        structure returned by wait4.
+
+        \param[in] status The raw status from wait4.
+
+        \param[in] ru The resource usage from wait4.
+
+        \param[out] usage The usage to be filled in (except wallMs).
+    */
+    static void fillUsage(const int status, const rusage& ru,
+                          ChildUsage& usage);
     
 private:
-    /** The only instance variable in this class.  It is initialized
-        to -1 in the constructor.  The value is changed by the
-        forkNexec method.
+    /** The PID of the child process.  It is initialized to -1 in the
+        constructor.  The value is changed by the forkNexec and spawn
+        methods.
     */
     int childPid;
+
+    /** The time at which the child process was started. */
+    std::chrono::steady_clock::time_point startTime;
+
+    /** The resources used by the child, filled in once it finishes. */
+    ChildUsage usage;
 };
 
 #endif
@@ -8,51 +8,32 @@
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <memory>
 #include <numeric>
 #include <unordered_map>
-#include <boost/asio.hpp>
 #include <stdexcept>
+#include <thread>
 
 #include "ChildProcess.h"
+#include "JobScheduler.h"
+#include "OutputCache.h"
+#include "Pipeline.h"
+#include "ScriptCache.h"
+#include "ScriptDownload.h"
+#include "UsageReport.h"
 
 // It is ok to use the following namespace delarations in C++ source
 // files only. They must never be used in header files.
-using namespace boost::asio;
-using namespace boost::asio::ip;
 using namespace std;
 
-void processUrl(std::istream& is);
-void readUrl(std::string url);
+void processUrl(std::string task, ScriptDownload& script, const int maxJobs,
+                UsageReport& report, OutputCache* cache);
+void readUrl(std::string task, std::string url, const int maxJobs,
+             UsageReport& report, OutputCache* cache,
+             const ScriptCache* scripts);
 std::vector<std::string> stringToVec(std::string str);
 void process(std::istream& is, const std::string& prompt);
 
-/**
- * Helper method to setup a TCP stream for downloading data from an
- * web-server.
- * 
- * @param host The host name of the web-server. Host names can be of
- * the from "www.miamioh.edu" or "ceclnx01.cec.miamioh.edu".  This
- * information is typically extracted from a given URL.
- *
- * @param path The path to the file being download.  An example of
- * this value is ""
- *
- * @param socket The TCP stream (aka socket) to be setup by this
- * method.  After a successful call to this method, this stream will
- * contain the response from the web-server to be processed.
- *
- * @param port An optional port number. The default port number is "80"
- *
- */
-void setupDownload(const std::string& hostName, const std::string& path,
-                   tcp::iostream& data, const std::string& port = "80") {
-    // Create a boost socket and request the log file from the server.
-    data.connect(hostName, port);
-    data << "GET "   << path     << " HTTP/1.1\r\n"
-         << "Host: " << hostName << "\r\n"
-         << "Connection: Close\r\n\r\n";
-}
-
 /**
  * A helper method that puts a vector together into a string
  *
@@ -71,59 +52,163 @@ std::string putTogether(vector<std::string> vec) {
 }
 
 /**
- * A helper method that is called to process a given input file
- * with data in HTTP-GET format.  This method must outputs a system output of
- * the number of lines and hacks detected
+ * A helper method to run one job of a SERIAL task and wait for it.  A
+ * cacheable job (see Job::cacheable) whose output is in the cache is
+ * not run; its saved output and exit code are used instead.  Otherwise
+ * the output of a cacheable job is captured and saved once it exits.
  *
- * @param is The input stream of ssh logs
+ * @param job The job to be run
+ *
+ * @param report The report to which the usage of the command is added
+ *
+ * @param cache The output cache to be used, or nullptr for none
+ *
+ * @return The exit code of the job
  */
-void processUrl(std::string task, std::istream& is) {
-    // Skipping to the bottom of the web-server
-    ChildProcess cp;
-    for (std::string hdr; std::getline(is, hdr) && !hdr.empty() && hdr != "\r";)
-    {}
-    for (std::string line; std::getline(is, line);) {
-        if (line.substr(0, 1) == "#" || line.substr(0, 1) == "") {
-            continue;
-        } else {
-            std::vector<std::string> vec;
-            std::string val;
-            std::istringstream is(line);
-            while (is >> std::quoted(val)) {
-                vec.push_back(val);
+int runSerial(Job& job, UsageReport& report, OutputCache* cache) {
+    std::string key;
+    if (cache == nullptr || !job.cacheable ||
+        !cache->key(job.cmd, job.inputs, key)) {
+        cout << "Running: " << job.cmd.str() << endl;
+        job.cmd.start();
+        const int exitCode = job.cmd.wait(&report);
+        cout << "Exit code: " << exitCode << endl;
+        return exitCode;
+    }
+    CachedResult saved;
+    if (cache->lookup(key, saved)) {
+        cout << "Cached: " << job.cmd.str() << endl;
+        OutputCache::replay(saved);
+        cout << "Exit code: " << saved.exitCode << endl;
+        return saved.exitCode;
+    }
+    cout << "Running: " << job.cmd.str() << endl;
+    OutputCapture capture = cache->beginCapture();
+    job.cmd.start(capture.outFd, capture.errFd);
+    const int exitCode = job.cmd.wait(&report);
+    cache->endCapture(key, capture, exitCode, job.cmd.wallMs());
+    cout << "Exit code: " << exitCode << endl;
+    return exitCode;
+}
+
+/**
+ * The jobs of a script that is still being downloaded, for a
+ * JobScheduler to run while the rest of the script arrives.
+ */
+class ScriptJobs : public JobSource {
+public:
+    /** The constructor.
+
+        \param[in,out] script The download with the lines of the script.
+    */
+    explicit ScriptJobs(ScriptDownload& script) : script(script) {}
+
+    int fd() const override {
+        return script.fd();
+    }
+
+    bool read(std::vector<Job>& jobs) override {
+        script.pump();
+        Job job;
+        for (std::string line; script.nextLine(line);) {
+            if (JobScheduler::parseJob(line, job)) {
+                jobs.push_back(job);
             }
+        }
+        return !script.done();
+    }
+
+private:
+    ScriptDownload& script;
+};
 
-            if (task == "SERIAL") {
-                cout << "Running: " << putTogether(vec) << endl;
-                cp.forkNexec(vec);
-                cout << "Exit code: " << cp.wait() << endl;
+/**
+ * A helper method that is called to process a script as it is being
+ * downloaded.  Each line is parsed into a Job (see JobScheduler.h for
+ * the JOB/AFTER/RUN syntax).  For SERIAL tasks each command is run (and
+ * waited on) as soon as its line arrives; a named job is skipped unless
+ * all the jobs it depends on have already succeeded.  For PARALLEL
+ * tasks the jobs are run concurrently, in dependency order, using a
+ * JobScheduler that starts each job as soon as it has arrived and its
+ * dependencies have succeeded.  If a cache is given, jobs
+ * with an INPUTS clause whose output is in the cache are not run; their
+ * saved output is replayed instead (see OutputCache).
+ *
+ * @param task The task we want to execute, serial or parallel
+ *
+ * @param script The download of the script with the commands to run
+ *
+ * @param maxJobs The maximum number of concurrent commands for PARALLEL
+ *
+ * @param report The report to which the usage of each command is added
+ *
+ * @param cache The output cache to be used, or nullptr for none
+ */
+void processUrl(std::string task, ScriptDownload& script, const int maxJobs,
+                UsageReport& report, OutputCache* cache) {
+    std::unordered_map<std::string, bool> succeeded;  // for SERIAL jobs
+    if (cache != nullptr) {
+        cache->resetStats();
+    }
+    try {
+        if (task == "PARALLEL") {
+            ScriptJobs jobs(script);
+            JobScheduler scheduler(maxJobs);
+            scheduler.run(cout, &report, cache, &jobs);
+        } else {
+            Job job;
+            for (std::string line; script.getline(line);) {
+                if (!JobScheduler::parseJob(line, job)) {
+                    continue;
+                }
+                // SERIAL: run right away unless a dependency failed
+                const bool ready = std::all_of(job.deps.begin(),
+                                               job.deps.end(),
+                    [&](const std::string& dep) { return succeeded[dep]; });
+                if (!ready) {
+                    cout << "Skipped (dependency failed): " << job.cmd.str()
+                         << endl;
+                    continue;
+                }
+                const int exitCode = runSerial(job, report, cache);
+                if (!job.name.empty()) {
+                    succeeded[job.name] = (exitCode == 0);
+                }
             }
         }
+    } catch (const std::runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    if (cache != nullptr) {
+        cache->printStats(cout);
     }
 }
 
 /**
- * A helper method that breaks down the url to match the format, calls the
- * setupDownload method and processUrl to store everything in a vector.
+ * A helper method that starts downloading a script (see ScriptDownload)
+ * and calls processUrl to run its commands as they arrive.
  * 
  * @param task The task we want to execute, serial or parallel
  * 
- * @param url The url we want to breakdown to match the format
+ * @param url The url of the script, "http://host[:port]/path"
+ *
+ * @param maxJobs The maximum number of concurrent commands for PARALLEL
+ *
+ * @param report The report to which the usage of each command is added
+ *
+ * @param cache The output cache to be used, or nullptr for none
+ *
+ * @param scripts The cache of downloaded scripts, or nullptr for none
  */
-void readUrl(std::string task, std::string url) {
-    std::vector<std::string> vec;
-
-    // Breaking down the url using two delimiters
-    std::string delim1 = "//";
-    std::string delim = "edu";
-    std::string host = url.substr(url.find(delim1) + 2, url.find(delim) +
-    delim.size() - url.find(delim1) - 2);
-    std::string path = url.substr(url.find(delim) + delim.size(),
-    url.size());
-
-    tcp::iostream is;  // stream to read ssh logs
-    setupDownload(host, path, is);  // calling this method to access the web url
-    processUrl(task, is);
+void readUrl(std::string task, std::string url, const int maxJobs,
+             UsageReport& report, OutputCache* cache,
+             const ScriptCache* scripts) {
+    try {
+        ScriptDownload script(url, scripts);
+        processUrl(task, script, maxJobs, report, cache);
+    } catch (const std::runtime_error& e) {
+        cout << "Error: " << e.what() << endl;  // e.g., connection refused
+    }
 }
 
 /**
@@ -162,10 +247,74 @@ std::string format(std::string s) {
     }
 }
 
+/**
+ * A helper method to handle the STATS command.  With no arguments it
+ * prints a summary of the resources used by all the commands run so
+ * far.  "STATS CSV <file>" and "STATS JSON <file>" export the usage of
+ * every command to the given file instead.
+ *
+ * @param is The stream with the arguments following STATS
+ *
+ * @param report The usage recorded for the commands run so far
+ */
+void showStats(std::istream& is, const UsageReport& report) {
+    std::string format, path;
+    if (!(is >> format >> path)) {
+        report.printSummary(cout);
+        return;
+    }
+    std::ofstream os(path);
+    if (!os.good()) {
+        cout << "Error opening file " << path << endl;
+    } else if (format == "CSV") {
+        report.writeCsv(os);
+    } else if (format == "JSON") {
+        report.writeJson(os);
+    } else {
+        cout << "Unknown STATS format " << format << endl;
+    }
+}
+
+/**
+ * A helper method to handle the CACHE command.  "CACHE <dir>" caches the
+ * output of cacheable jobs in the given directory (which is created if
+ * needed), and downloaded scripts in its "scripts" subdirectory.  "CACHE
+ * OFF" stops caching.
+ *
+ * @param is The stream with the argument following CACHE
+ *
+ * @param cache The output cache to be replaced (reset for OFF)
+ *
+ * @param scripts The script cache to be replaced (reset for OFF)
+ */
+void setCache(std::istream& is, std::unique_ptr<OutputCache>& cache,
+              std::unique_ptr<ScriptCache>& scripts) {
+    std::string dir;
+    if (!(is >> std::quoted(dir))) {
+        cout << "Usage: CACHE <dir> | CACHE OFF" << endl;
+    } else if (dir == "OFF") {
+        cache.reset();
+        scripts.reset();
+    } else {
+        try {
+            cache.reset(new OutputCache(dir));
+            scripts.reset(new ScriptCache(dir + "/scripts"));
+        } catch (const std::runtime_error& e) {
+            cout << "Error: " << e.what() << endl;
+        }
+    }
+}
+
 /**
  * A top level method that takes the user input and executes them on the
  * terminal. The user can either call a command line arguement or call
- * series or parallel on a web url.
+ * series or parallel on a web url.  PARALLEL accepts an optional maximum
+ * number of concurrent commands (for example, "PARALLEL <url> 4"), which
+ * defaults to the number of CPU cores.  Commands may be pipelines with
+ * redirections, e.g. "sort < in.txt | uniq -c > out.txt".  STATS
+ * reports the resources used by the commands run so far (see
+ * showStats).  CACHE turns the output and script caches for SERIAL
+ * and PARALLEL on or off (see setCache).
  * 
  * @param is the user input
  * 
@@ -174,7 +323,9 @@ std::string format(std::string s) {
 void process(std::istream& is = std::cin, const std::string& prompt = "> ") { 
     // Adapt the following loop as you see fit
     std::string line;
-    ChildProcess cp;
+    UsageReport report;
+    std::unique_ptr<OutputCache> cache;
+    std::unique_ptr<ScriptCache> scripts;
     while (std::cout << prompt, std::getline(std::cin, line)) {
         // Process the input line here.
         std::string firstW;
@@ -186,14 +337,29 @@ void process(std::istream& is = std::cin, const std::string& prompt = "> ") {
             if (firstW == "SERIAL" || firstW == "PARALLEL") {
                 std::string task = firstW;
                 is >> firstW;
-                readUrl(task, firstW);
+                int maxJobs = 0;
+                if (!(is >> maxJobs) || maxJobs < 1) {
+                    maxJobs = std::max(1U,
+                                       std::thread::hardware_concurrency());
+                }
+                readUrl(task, firstW, maxJobs, report, cache.get(),
+                        scripts.get());
+            } else if (firstW == "STATS") {
+                showStats(is, report);
+            } else if (firstW == "CACHE") {
+                setCache(is, cache, scripts);
             } else {
                 if (firstW == "") {
                     continue;
                 } else if (firstW == "exit") { break; } else {
                     cout << "Running: " << format(line) << endl;
-                    cp.forkNexec(stringToVec(line));
-                    cout << "Exit code: " << cp.wait() << endl;
+                    try {
+                        Pipeline cmd = Pipeline::parse(line);
+                        cmd.start();
+                        cout << "Exit code: " << cmd.wait(&report) << endl;
+                    } catch (const std::runtime_error& e) {
+                        cout << "Error: " << e.what() << endl;
+                    }
                 }
             }
         }
@@ -0,0 +1,416 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the JobScheduler class.
+ *
+ */
+
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include "JobScheduler.h"
+
+JobScheduler::JobScheduler(const int maxJobs) :
+    maxJobs(std::max(1, maxJobs)) { }
+
+// Plain lines become anonymous jobs. JOB lines are split into the name,
+// the names following AFTER, the files following INPUTS, and the command
+// following RUN.  The command is parsed as a Pipeline so it may use "|",
+// "<", ">", and ">>".
+bool JobScheduler::parseJob(const std::string& line, Job& job) {
+    job = Job();
+    std::istringstream is(line);
+    std::string tok;
+    if (!(is >> std::quoted(tok)) || tok.substr(0, 1) == "#") {
+        return false;
+    }
+    if (tok != "JOB") {
+        job.cmd = Pipeline::parse(line);
+        return true;
+    }
+
+    // Named job: JOB <name> [AFTER <deps...>] [INPUTS <files...>] RUN <cmd...>
+    if (!(is >> std::quoted(job.name)) || job.name == "AFTER" ||
+        job.name == "INPUTS" || job.name == "RUN") {
+        throw std::runtime_error("JOB without a name: " + line);
+    }
+    is >> std::quoted(tok);
+    if (tok == "AFTER") {
+        while (is >> std::quoted(tok) && tok != "RUN" && tok != "INPUTS") {
+            job.deps.push_back(tok);
+        }
+    }
+    if (is && tok == "INPUTS") {
+        job.cacheable = true;
+        while (is >> std::quoted(tok) && tok != "RUN") {
+            job.inputs.push_back(tok);
+        }
+    }
+    if (!is || tok != "RUN") {
+        throw std::runtime_error("JOB without a RUN command: " + line);
+    }
+    const auto pos = is.tellg();  // -1 if nothing follows RUN
+    job.cmd = Pipeline::parse(pos == -1 ? "" : line.substr(pos));
+    if (job.cmd.empty()) {
+        throw std::runtime_error("JOB without a RUN command: " + line);
+    }
+    return true;
+}
+
+void JobScheduler::add(const Job& job) {
+    jobs.push_back(job);
+}
+
+// Kahn's algorithm gives a topological order (and detects cycles).
+// Walking that order backwards computes each job's critical path.
+void JobScheduler::buildGraph() {
+    const size_t count = jobs.size();
+    std::unordered_map<std::string, size_t> byName;
+    for (size_t i = 0; (i < count); i++) {
+        if (!jobs[i].name.empty() &&
+            !byName.emplace(jobs[i].name, i).second) {
+            throw std::runtime_error("Duplicate job name: " + jobs[i].name);
+        }
+    }
+
+    children.assign(count, {});
+    pending.assign(count, 0);
+    for (size_t i = 0; (i < count); i++) {
+        for (const auto& dep : jobs[i].deps) {
+            const auto entry = byName.find(dep);
+            if (entry == byName.end()) {
+                throw std::runtime_error("Unknown dependency " + dep +
+                                         " for job " + jobs[i].name);
+            }
+            children[entry->second].push_back(i);
+            pending[i]++;
+        }
+    }
+
+    std::vector<int> indegree = pending;
+    std::vector<size_t> order;
+    for (size_t i = 0; (i < count); i++) {
+        if (indegree[i] == 0) {
+            order.push_back(i);
+        }
+    }
+    for (size_t k = 0; (k < order.size()); k++) {
+        for (size_t child : children[order[k]]) {
+            if (--indegree[child] == 0) {
+                order.push_back(child);
+            }
+        }
+    }
+    if (order.size() != count) {
+        throw std::runtime_error("Job dependencies contain a cycle");
+    }
+
+    priority.assign(count, 1);
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        for (size_t child : children[*it]) {
+            priority[*it] = std::max(priority[*it], priority[child] + 1);
+        }
+    }
+}
+
+void JobScheduler::resetState() {
+    const size_t count = jobs.size();
+    started.assign(count, false);
+    done.assign(count, false);
+    cached.assign(count, false);
+    skipped.assign(count, false);
+    exitCodes.assign(count, -1);
+    stagesLeft.assign(count, 0);
+    keys.assign(count, "");
+    captures.assign(count, OutputCapture());
+    running.clear();
+    runningJobs = 0;
+    graphReady = false;
+    ready = decltype(ready)();
+}
+
+void JobScheduler::makeReady(const size_t i) {
+    if (!started[i]) {
+        ready.emplace(priority[i], -static_cast<long>(i));
+    }
+}
+
+// A failed job marks every (transitive) dependent as skipped.
+void JobScheduler::finishJob(const size_t i, const int exitCode) {
+    done[i] = true;
+    exitCodes[i] = exitCode;
+    if (!graphReady) {
+        return;  // Dependents are resolved once the graph is built
+    }
+    if (exitCode == 0) {
+        for (size_t child : children[i]) {
+            if (--pending[child] == 0 && !skipped[child]) {
+                makeReady(child);
+            }
+        }
+        return;
+    }
+    std::vector<size_t> stack(children[i]);
+    while (!stack.empty()) {
+        const size_t j = stack.back();
+        stack.pop_back();
+        if (!skipped[j]) {
+            skipped[j] = true;
+            stack.insert(stack.end(), children[j].begin(), children[j].end());
+        }
+    }
+}
+
+void JobScheduler::startJob(const size_t i, std::ostream& os,
+                            OutputCache* cache) {
+    started[i] = true;
+    CachedResult saved;
+    if (cache != nullptr && jobs[i].cacheable &&
+        cache->key(jobs[i].cmd, jobs[i].inputs, keys[i]) &&
+        cache->lookup(keys[i], saved)) {
+        os << "Cached: " << jobs[i].cmd.str() << std::endl;
+        OutputCache::replay(saved);
+        cached[i] = true;
+        finishJob(i, saved.exitCode);
+        return;
+    }
+    if (!keys[i].empty()) {
+        captures[i] = cache->beginCapture();
+    }
+    os << "Running: " << jobs[i].cmd.str() << std::endl;
+    stagesLeft[i] = jobs[i].cmd.start(captures[i].outFd, captures[i].errFd);
+    for (const int pid : jobs[i].cmd.getPids()) {
+        running[pid] = i;
+    }
+    if (stagesLeft[i] > 0) {
+        runningJobs++;
+        return;
+    }
+    // Could not even start the job
+    if (!keys[i].empty()) {
+        cache->endCapture(keys[i], captures[i], -1, 0);
+    }
+    finishJob(i, jobs[i].cmd.exitCode());
+}
+
+int JobScheduler::reapChild(UsageReport* report, OutputCache* cache) {
+    ChildUsage usage;
+    const int pid = ChildProcess::waitAny(usage);
+    const auto entry = running.find(pid);
+    if (entry == running.end()) {
+        return pid;  // No children left (-1), or not one of the jobs
+    }
+    const size_t i = entry->second;
+    running.erase(entry);
+    jobs[i].cmd.setUsage(pid, usage, report);
+    if (--stagesLeft[i] > 0) {
+        return pid;  // Other stages of this pipeline are still running
+    }
+    runningJobs--;
+    if (!keys[i].empty()) {
+        cache->endCapture(keys[i], captures[i], jobs[i].cmd.exitCode(),
+                          jobs[i].cmd.wallMs());
+    }
+    finishJob(i, jobs[i].cmd.exitCode());
+    return pid;
+}
+
+// Without the whole graph, there is no critical path to go by, so jobs
+// are started in script order.  A pidfd for every running stage lets a
+// single poll wait for either more of the script or a stage to exit.
+void JobScheduler::streamJobs(JobSource& source, std::ostream& os,
+                              UsageReport* report, OutputCache* cache) {
+    std::unordered_map<std::string, size_t> byName;
+    std::unordered_map<int, int> pidFds;    // pid -> pidfd
+    // Closes the pidfds on every way out, including an exception from
+    // source.read (e.g., a malformed line) or from starting a job.
+    struct PidFdCloser {
+        std::unordered_map<int, int>& fds;
+        ~PidFdCloser() {
+            for (const auto& entry : fds) {
+                close(entry.second);
+            }
+        }
+    } closer{pidFds};
+    std::vector<size_t> waiting;            // Jobs not yet started
+    bool canStart = true;                   // False without pidfds
+    auto receive = [&](const size_t i) {
+        if (!jobs[i].name.empty()) {
+            byName.emplace(jobs[i].name, i);  // buildGraph rejects dups
+        }
+        waiting.push_back(i);
+    };
+    // A job may start once every job it depends on has succeeded.
+    auto depsDone = [&](const size_t i) {
+        if (!jobs[i].name.empty() && byName.at(jobs[i].name) != i) {
+            return false;  // A duplicate name: buildGraph will throw
+        }
+        return std::all_of(jobs[i].deps.begin(), jobs[i].deps.end(),
+            [&](const std::string& dep) {
+                const auto entry = byName.find(dep);
+                return entry != byName.end() && done[entry->second] &&
+                    exitCodes[entry->second] == 0;
+            });
+    };
+    for (size_t i = 0; (i < jobs.size()); i++) {
+        receive(i);  // Jobs added before run
+    }
+
+    for (bool more = true; more;) {
+        std::vector<Job> received;
+        more = source.read(received);
+        for (const Job& job : received) {
+            jobs.push_back(job);
+            started.push_back(false);
+            done.push_back(false);
+            cached.push_back(false);
+            skipped.push_back(false);
+            exitCodes.push_back(-1);
+            stagesLeft.push_back(0);
+            keys.emplace_back();
+            captures.emplace_back();
+            receive(jobs.size() - 1);
+        }
+        // Start what can be started.  A job replayed from the cache
+        // finishes right away and may let earlier waiting jobs start.
+        for (bool progress = canStart; progress;) {
+            progress = false;
+            for (auto it = waiting.begin();
+                 it != waiting.end() && runningJobs < maxJobs;) {
+                if (!depsDone(*it)) {
+                    it++;
+                    continue;
+                }
+                const size_t i = *it;
+                it = waiting.erase(it);
+                startJob(i, os, cache);
+                progress = true;
+                for (const int pid : jobs[i].cmd.getPids()) {
+                    const int fd = ChildProcess::openPidFd(pid);
+                    if (fd == -1) {
+                        canStart = false;  // Finish the download first
+                    } else {
+                        pidFds[pid] = fd;
+                    }
+                }
+            }
+            progress = progress && canStart;
+        }
+        if (!more) {
+            break;
+        }
+
+        // Wait for more of the script or for a stage to exit.
+        std::vector<pollfd> fds;
+        if (source.fd() != -1) {
+            fds.push_back({source.fd(), POLLIN, 0});
+        }
+        const size_t firstPid = fds.size();
+        for (const auto& entry : pidFds) {
+            fds.push_back({entry.second, POLLIN, 0});
+        }
+        if (fds.empty() || poll(fds.data(), fds.size(), -1) <= 0) {
+            continue;
+        }
+        for (size_t k = firstPid; (k < fds.size()); k++) {
+            if (fds[k].revents == 0) {
+                continue;
+            }
+            // Reaps an exited child (not necessarily this one)
+            const auto entry = pidFds.find(reapChild(report, cache));
+            if (entry != pidFds.end()) {
+                close(entry->second);
+                pidFds.erase(entry);
+            }
+        }
+    }
+}
+
+void JobScheduler::scheduleAll(std::ostream& os, UsageReport* report,
+                               OutputCache* cache) {
+    // Jobs that already finished (while streaming) ready or skip their
+    // dependents just as if they had finished now.
+    graphReady = true;
+    for (size_t i = 0; (i < jobs.size()); i++) {
+        if (pending[i] == 0) {
+            makeReady(i);
+        }
+    }
+    for (size_t i = 0; (i < jobs.size()); i++) {
+        if (done[i]) {
+            finishJob(i, exitCodes[i]);
+        }
+    }
+
+    while (!ready.empty() || !running.empty()) {
+        // Fill up any free slots with the highest-priority ready jobs.
+        while (!ready.empty() && runningJobs < maxJobs) {
+            const size_t i = -ready.top().second;
+            ready.pop();
+            startJob(i, os, cache);
+        }
+        // Reap whichever child finishes first.
+        if (!running.empty() && reapChild(report, cache) == -1) {
+            break;  // No more children to wait for.
+        }
+    }
+}
+
+void JobScheduler::run(std::ostream& os, UsageReport* report,
+                       OutputCache* cache, JobSource* source) {
+    using Clock = std::chrono::steady_clock;
+    if (source == nullptr) {
+        buildGraph();  // Before any job is started
+    }
+    resetState();
+
+    const auto begin = Clock::now();
+    try {
+        if (source != nullptr) {
+            streamJobs(*source, os, report, cache);
+            buildGraph();
+        }
+        scheduleAll(os, report, cache);
+    } catch (...) {
+        // Do not leave behind jobs that were already started.
+        while (!running.empty() && reapChild(report, cache) != -1) {}
+        throw;
+    }
+    const double makespan = std::chrono::duration<double, std::milli>(
+        Clock::now() - begin).count();
+
+    // Report results in the order the jobs were listed.
+    const size_t count = jobs.size();
+    double serialMs = 0;
+    const auto flags = os.flags();
+    const auto precision = os.precision();
+    os << std::fixed << std::setprecision(1);
+    for (size_t i = 0; (i < count); i++) {
+        if (skipped[i]) {
+            os << "Skipped (dependency failed): " << jobs[i].cmd.str()
+               << std::endl;
+            continue;
+        }
+        if (cached[i]) {
+            os << "Exit code: " << exitCodes[i] << " [cached] "
+               << jobs[i].cmd.str() << std::endl;
+            continue;
+        }
+        os << "Exit code: " << jobs[i].cmd.exitCode() << " ["
+           << jobs[i].cmd.wallMs() << " ms] " << jobs[i].cmd.str()
+           << std::endl;
+        serialMs += jobs[i].cmd.wallMs();
+    }
+    os << "Makespan: " << makespan << " ms with " << maxJobs
+       << " jobs (serial total: " << serialMs << " ms)" << std::endl;
+    os.flags(flags);
+    os.precision(precision);
+}
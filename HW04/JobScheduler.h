@@ -0,0 +1,226 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+/**
+ * This source file contains the definition for the JobScheduler
+ * class.  This class runs the commands in a job script concurrently
+ * while honoring the dependencies declared between them.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <iostream>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ChildProcess.h"
+#include "OutputCache.h"
+#include "Pipeline.h"
+#include "UsageReport.h"
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A single entry in a job script.  A script line is either a plain
+ * command (an anonymous job with no dependencies) or a named job of the
+ * form:
+ *
+ *  \code
+ *
+ *    JOB <name> [AFTER <dep1> ...] [INPUTS <file1> ...] RUN <cmd> <args...>
+ *
+ *  \endcode
+ *
+ * A job with an INPUTS clause (which may list no files) declares that
+ * its output depends only on its command line and those files (plus any
+ * "<" redirections), so its output may be cached (see OutputCache).
+ */
+struct Job {
+    /** The name of the job. Empty for plain (anonymous) commands. */
+    std::string name;
+    /** The names of the jobs that must succeed before this one runs. */
+    StrVec deps;
+    /** The files, other than "<" redirections, the command reads. */
+    StrVec inputs;
+    /** True if the job had an INPUTS clause, i.e., may be cached. */
+    bool cacheable = false;
+    /** The command-line (possibly a pipeline) to be executed. */
+    Pipeline cmd;
+};
+
+/**
+ * A source of jobs that are still arriving (e.g., a script that is still
+ * being downloaded) while the jobs received so far are run.
+ */
+class JobSource {
+public:
+    /** The destructor. */
+    virtual ~JobSource() {}
+
+    /** Obtain a descriptor that becomes readable when more jobs may be
+        available.
+
+        \return The descriptor, or -1 once all jobs have been received.
+    */
+    virtual int fd() const = 0;
+
+    /** Obtain the jobs that have arrived, without blocking.  This method
+        may throw a std::runtime_error (e.g., for a malformed JOB line).
+
+        \param[out] jobs The vector to which the jobs are added.
+
+        \return False once all of the jobs have been received.
+    */
+    virtual bool read(std::vector<Job>& jobs) = 0;
+};
+
+/**
+ * A class that runs a set of jobs as a dependency graph (DAG).  Jobs
+ * whose dependencies have all succeeded are started, up to a fixed
+ * number at a time, in critical-path order: the ready job with the
+ * longest chain of jobs waiting on it goes first.  When a job fails,
+ * every job that (directly or indirectly) depends on it is skipped.
+ */
+class JobScheduler {
+public:
+    /** The constructor.
+
+        \param[in] maxJobs The maximum number of jobs to run at the
+        same time.  Values less than 1 are treated as 1.
+    */
+    explicit JobScheduler(const int maxJobs);
+
+    /** Parse one line of a job script.
+
+        \param[in] line The line to be parsed.  Tokens are read using
+        std::quoted so arguments may contain spaces.  The command may
+        be a pipeline with redirections (see Pipeline::parse).
+
+        \param[out] job The job parsed from the line.
+
+        \return This method returns false if the line is blank or a
+        comment, i.e., it does not describe a job.  It throws a
+        std::runtime_error if a JOB line is malformed.
+    */
+    static bool parseJob(const std::string& line, Job& job);
+
+    /** Add a job to be run by this scheduler.  Jobs are reported in
+        the order in which they are added.
+
+        \param[in] job The job to be added.
+    */
+    void add(const Job& job);
+
+    /** Run all of the jobs added to this scheduler and wait for them
+        to finish.  Progress and a per-job summary (exit code and wall
+        time, in the order jobs were added) are printed to os.  This
+        method throws a std::runtime_error if a job names an unknown
+        dependency, if two jobs share a name, or if the dependencies
+        contain a cycle.  In these cases no job is started.
+
+        \param[out] os The output stream to where progress and results
+        are to be written.
+
+        \param[out] report An optional report to which the resource
+        usage of every job that ran is added.
+
+        \param[in,out] cache An optional cache for the output of
+        cacheable jobs.  A job found in the cache is not run: its saved
+        output is replayed and it completes with the saved exit code.
+
+        \param[in,out] source An optional source of more jobs.  Until it
+        has delivered all of its jobs, each job is started (in script
+        order) as soon as it has arrived and all the jobs it depends on
+        have succeeded; the critical-path order applies from then on.
+        The checks for unknown dependencies, duplicate names, and cycles
+        are then made once all jobs have arrived, so jobs may already
+        have run; they are waited for before the exception is thrown.
+    */
+    void run(std::ostream& os, UsageReport* report = nullptr,
+             OutputCache* cache = nullptr, JobSource* source = nullptr);
+
+private:
+    /** Helper method to resolve dependency names into indexes into
+        jobs, check for cycles, and compute the critical-path priority
+        of every job.  Populates the children, pending, and priority
+        instance variables.
+    */
+    void buildGraph();
+
+    /** Helper method to reset the state of every job for a run. */
+    void resetState();
+
+    /** Helper method to receive jobs from a source and start each one
+        as soon as its dependencies have succeeded, until the source has
+        delivered all of its jobs.  Jobs still running when this method
+        returns are left in running.
+    */
+    void streamJobs(JobSource& source, std::ostream& os,
+                    UsageReport* report, OutputCache* cache);
+
+    /** Helper method to run the jobs in critical-path order (see
+        buildGraph, which must have been called) until all have
+        finished or been skipped.
+    */
+    void scheduleAll(std::ostream& os, UsageReport* report,
+                     OutputCache* cache);
+
+    /** Helper method to start a job, or to replay its output if it is
+        in the cache (in which case it finishes right away).
+    */
+    void startJob(const size_t i, std::ostream& os, OutputCache* cache);
+
+    /** Helper method to wait for a child to exit and to finish its job
+        if it was the last stage still running.
+
+        \return The PID of the child, or -1 if there is none.
+    */
+    int reapChild(UsageReport* report, OutputCache* cache);
+
+    /** Helper method to record the exit code of a job.  Once the graph
+        is built, the jobs depending on it are readied (or skipped if it
+        failed).
+    */
+    void finishJob(const size_t i, const int exitCode);
+
+    /** Helper method to add a job to the ready queue (unless it was
+        already started).
+    */
+    void makeReady(const size_t i);
+
+    /** The maximum number of jobs to run at the same time. */
+    int maxJobs;
+    /** The jobs to be run, in the order they were added. */
+    std::vector<Job> jobs;
+    /** For each job, the indexes of the jobs that depend on it. */
+    std::vector<std::vector<size_t>> children;
+    /** For each job, the number of dependencies yet to succeed. */
+    std::vector<int> pending;
+    /** For each job, the number of jobs on the longest dependency
+        chain starting at it (including itself). */
+    std::vector<int> priority;
+
+    /** The state of each job during a run: whether it was started,
+        finished, replayed from the cache, or skipped; its exit code;
+        and the number of its stages still running. */
+    std::vector<bool> started, done, cached, skipped;
+    std::vector<int> exitCodes, stagesLeft;
+    /** For each job, its cache key (empty if not cached) and the files
+        capturing its output. */
+    std::vector<std::string> keys;
+    std::vector<OutputCapture> captures;
+    /** The PIDs of the stages running, mapped to indexes into jobs. */
+    std::unordered_map<int, size_t> running;
+    /** The number of jobs with stages still running. */
+    int runningJobs = 0;
+    /** True once buildGraph has been called for the current run. */
+    bool graphReady = false;
+    /** Ready jobs ordered by longest critical path, then script order. */
+    std::priority_queue<std::pair<int, long>> ready;
+};
+
+#endif
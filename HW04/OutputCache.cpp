@@ -0,0 +1,388 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the OutputCache class, along with a small SHA-256
+ * implementation (FIPS 180-4) used to compute the keys.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "OutputCache.h"
+
+namespace {
+
+/**
+ * An incremental SHA-256 hash.
+ */
+class Sha256 {
+public:
+    /** Add bytes to the hash. */
+    void update(const void* data, size_t len) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        total += len;
+        while (len > 0) {
+            const size_t n = std::min(len, sizeof(block) - used);
+            std::memcpy(block + used, bytes, n);
+            used += n;
+            bytes += n;
+            len -= n;
+            if (used == sizeof(block)) {
+                compress();
+                used = 0;
+            }
+        }
+    }
+
+    /** Add a string, preceded by its length so that the boundaries
+        between strings are part of the hash. */
+    void add(const std::string& str) {
+        const uint64_t len = str.size();
+        update(&len, sizeof(len));
+        update(str.data(), str.size());
+    }
+
+    /** Finish the hash.
+
+        \return The digest as 64 hex digits.
+    */
+    std::string hex() {
+        const uint64_t bits = total * 8;
+        const unsigned char pad = 0x80, zero = 0;
+        update(&pad, 1);
+        while (used != 56) {
+            update(&zero, 1);
+        }
+        for (int i = 7; (i >= 0); i--) {
+            const unsigned char b = bits >> (i * 8);
+            update(&b, 1);
+        }
+        std::ostringstream os;
+        for (const uint32_t word : state) {
+            os << std::hex << std::setw(8) << std::setfill('0') << word;
+        }
+        return os.str();
+    }
+
+private:
+    static uint32_t rotr(const uint32_t x, const int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void compress() {
+        static const uint32_t K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+            0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+            0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+            0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+            0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+            0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+            0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+            0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+            0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+            0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+            0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+            0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        uint32_t w[64];
+        for (int i = 0; (i < 16); i++) {
+            w[i] = (uint32_t(block[4 * i]) << 24) |
+                (uint32_t(block[4 * i + 1]) << 16) |
+                (uint32_t(block[4 * i + 2]) << 8) | block[4 * i + 3];
+        }
+        for (int i = 16; (i < 64); i++) {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^
+                (w[i - 15] >> 3);
+            const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^
+                (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; (i < 64); i++) {
+            const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            const uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            const uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            const uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char block[64];
+    size_t used = 0;
+    uint64_t total = 0;
+};
+
+/**
+ * Helper method to add an input file to a key: its path, size,
+ * modification time, and contents.  A missing file is hashed as such,
+ * so that creating it later changes the key.
+ *
+ * @param hash The hash being computed.
+ *
+ * @param path The input file.
+ */
+void addFile(Sha256& hash, const std::string& path) {
+    hash.add(path);
+    struct stat st;
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        hash.add("missing");
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    const int64_t meta[3] = {st.st_size, st.st_mtim.tv_sec,
+                             st.st_mtim.tv_nsec};
+    hash.update(meta, sizeof(meta));
+    char buf[65536];
+    for (ssize_t n; (n = read(fd, buf, sizeof(buf))) != 0;) {
+        if (n == -1 && errno != EINTR) {
+            hash.add("unreadable");
+            break;
+        }
+        hash.update(buf, std::max<ssize_t>(n, 0));
+    }
+    close(fd);
+}
+
+/**
+ * Helper method to read all of a file from the start.
+ *
+ * @param fd The file.
+ *
+ * @return The contents.
+ */
+std::string readAll(const int fd) {
+    std::string data;
+    char buf[65536];
+    for (off_t off = 0;;) {
+        const ssize_t n = pread(fd, buf, sizeof(buf), off);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return data;
+        }
+        data.append(buf, n);
+        off += n;
+    }
+}
+
+/**
+ * Helper method to write all of a string to a descriptor.
+ */
+void writeAll(const int fd, const std::string& data) {
+    for (size_t done = 0; (done < data.size());) {
+        const ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        done += n;
+    }
+}
+
+/**
+ * Helper method to create an unlinked temporary file in a directory.
+ */
+int tempFile(const std::string& dir) {
+    const int fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd != -1) {
+        return fd;
+    }
+    // Not all file systems support O_TMPFILE
+    std::string path = dir + "/capture.XXXXXX";
+    const int tmp = mkostemp(&path[0], O_CLOEXEC);
+    if (tmp != -1) {
+        unlink(path.c_str());
+    }
+    return tmp;
+}
+
+/** The first bytes of every entry, and the entry format version. */
+const char EntryMagic[4] = {'H', 'W', '4', 'O'};
+const uint32_t EntryVersion = 1;
+
+}  // namespace
+
+OutputCache::OutputCache(const std::string& dir) : dir(dir) {
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        throw std::runtime_error("Unable to create cache directory " + dir);
+    }
+}
+
+std::string OutputCache::entryPath(const std::string& key) const {
+    return dir + "/" + key;
+}
+
+bool OutputCache::key(const Pipeline& cmd, const StrVec& inputs,
+                      std::string& key) const {
+    Sha256 hash;
+    hash.add("HW04 output cache v1");
+    char cwd[PATH_MAX];
+    hash.add(getcwd(cwd, sizeof(cwd)) != nullptr ? cwd : "");
+    for (const Stage& stage : cmd.getStages()) {
+        if (!stage.outFile.empty()) {
+            return false;  // Writes a file that a replay would not
+        }
+        hash.add("stage");
+        for (const auto& arg : stage.argv) {
+            hash.add(arg);
+        }
+        hash.add("<");
+        if (!stage.inFile.empty()) {
+            addFile(hash, stage.inFile);
+        }
+    }
+    hash.add("inputs");
+    for (const auto& input : inputs) {
+        addFile(hash, input);
+    }
+    key = hash.hex();
+    return true;
+}
+
+bool OutputCache::lookup(const std::string& key, CachedResult& res) {
+    std::ifstream is(entryPath(key), std::ios::binary);
+    char magic[4];
+    uint32_t version = 0;
+    int32_t exitCode = -1;
+    uint64_t outLen = 0, errLen = 0;
+    double wallMs = 0;
+    if (is.read(magic, 4) &&
+        std::equal(magic, magic + 4, EntryMagic) &&
+        is.read(reinterpret_cast<char*>(&version), sizeof(version)) &&
+        version == EntryVersion &&
+        is.read(reinterpret_cast<char*>(&exitCode), sizeof(exitCode)) &&
+        is.read(reinterpret_cast<char*>(&wallMs), sizeof(wallMs)) &&
+        is.read(reinterpret_cast<char*>(&outLen), sizeof(outLen)) &&
+        is.read(reinterpret_cast<char*>(&errLen), sizeof(errLen))) {
+        res.out.resize(outLen);
+        res.err.resize(errLen);
+        if (is.read(&res.out[0], outLen) && is.read(&res.err[0], errLen)) {
+            res.exitCode = exitCode;
+            res.wallMs   = wallMs;
+            hits++;
+            savedMs += wallMs;
+            return true;
+        }
+    }
+    misses++;
+    return false;
+}
+
+void OutputCache::replay(const CachedResult& res) {
+    std::cout.flush();
+    writeAll(STDOUT_FILENO, res.out);
+    writeAll(STDERR_FILENO, res.err);
+}
+
+OutputCapture OutputCache::beginCapture() const {
+    OutputCapture capture;
+    capture.outFd = tempFile(dir);
+    capture.errFd = tempFile(dir);
+    if (capture.outFd == -1 || capture.errFd == -1) {
+        if (capture.outFd != -1) {
+            close(capture.outFd);
+        }
+        if (capture.errFd != -1) {
+            close(capture.errFd);
+        }
+        return OutputCapture();
+    }
+    return capture;
+}
+
+// The entry is written to a temporary name and renamed, so that
+// concurrent shells (or a crash) never see a partial entry.
+void OutputCache::endCapture(const std::string& key, OutputCapture& capture,
+                             const int exitCode, const double wallMs) {
+    if (capture.outFd == -1) {
+        return;
+    }
+    CachedResult res;
+    res.out = readAll(capture.outFd);
+    res.err = readAll(capture.errFd);
+    close(capture.outFd);
+    close(capture.errFd);
+    capture = OutputCapture();
+    replay(res);
+    if (exitCode < 0 || exitCode >= 128) {
+        return;
+    }
+
+    const std::string path = entryPath(key);
+    const std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream os(tmpPath, std::ios::binary);
+        const int32_t code = exitCode;
+        const uint64_t outLen = res.out.size(), errLen = res.err.size();
+        os.write(EntryMagic, 4);
+        os.write(reinterpret_cast<const char*>(&EntryVersion),
+                 sizeof(EntryVersion));
+        os.write(reinterpret_cast<const char*>(&code), sizeof(code));
+        os.write(reinterpret_cast<const char*>(&wallMs), sizeof(wallMs));
+        os.write(reinterpret_cast<const char*>(&outLen), sizeof(outLen));
+        os.write(reinterpret_cast<const char*>(&errLen), sizeof(errLen));
+        os << res.out << res.err;
+        if (!os.good()) {
+            os.close();
+            unlink(tmpPath.c_str());
+            return;  // A full disk only costs a future cache miss
+        }
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+    }
+}
+
+void OutputCache::resetStats() {
+    hits = misses = 0;
+    savedMs = 0;
+}
+
+void OutputCache::printStats(std::ostream& os) const {
+    const size_t lookups = hits + misses;
+    const auto flags = os.flags();
+    const auto precision = os.precision();
+    os << std::fixed << std::setprecision(1) << "Cache: " << hits
+       << " hits, " << misses << " misses ("
+       << (lookups == 0 ? 0.0 : 100.0 * hits / lookups)
+       << "% hit rate), saved " << savedMs << " ms" << std::endl;
+    os.flags(flags);
+    os.precision(precision);
+}
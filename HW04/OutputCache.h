@@ -0,0 +1,146 @@
+#ifndef OUTPUT_CACHE_H
+#define OUTPUT_CACHE_H
+
+/**
+ * This source file contains the definition for the OutputCache class.
+ * This class lets the shell skip deterministic commands that were
+ * already run with the same arguments and the same input files, by
+ * replaying the output saved from the earlier run.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Pipeline.h"
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * The saved results of running a command.
+ */
+struct CachedResult {
+    /** The exit code of the command. */
+    int exitCode = -1;
+    /** The wall time of the run that was saved, in ms. */
+    double wallMs = 0;
+    /** What the command wrote to its standard output and error. */
+    std::string out, err;
+};
+
+/**
+ * Temporary files that capture the output of a command being run, so
+ * that the output can be saved once the command finishes.
+ */
+struct OutputCapture {
+    /** The (already unlinked) files for stdout and stderr, or -1. */
+    int outFd = -1, errFd = -1;
+};
+
+/**
+ * A content-addressed cache of command output in a directory.  The
+ * key of a command is a SHA-256 hash of the working directory, the
+ * command line (arguments and redirections), and the path, size,
+ * modification time, and contents of its input files (those named
+ * after "<" plus any declared by the job).  Each entry is a file named
+ * by the key that holds the exit code, the wall time, and the stdout
+ * and stderr of the run.
+ *
+ * Commands that write to files (">" or ">>") are never cached,
+ * since replaying stdout would not recreate their files.
+ */
+class OutputCache {
+public:
+    /** The constructor.
+
+        \param[in] dir The directory for the entries.  It is created if
+        it does not exist.  A std::runtime_error is thrown if it cannot
+        be created.
+    */
+    explicit OutputCache(const std::string& dir);
+
+    /** Compute the key of a command.
+
+        \param[in] cmd The command to be run.
+
+        \param[in] inputs Files (other than those after "<") that the
+        command reads.
+
+        \param[out] key The key, as a hex string.
+
+        \return False if the command cannot be cached.
+    */
+    bool key(const Pipeline& cmd, const StrVec& inputs,
+             std::string& key) const;
+
+    /** Look up the saved result of a command and count a hit or miss.
+
+        \param[in] key The key from the key method.
+
+        \param[out] res The saved result, if any.
+
+        \return True on a hit.
+    */
+    bool lookup(const std::string& key, CachedResult& res);
+
+    /** Write a saved result to this process's stdout and stderr, as if
+        the command had just run.  std::cout is flushed first so the
+        output appears in order.
+
+        \param[in] res The result to be replayed.
+    */
+    static void replay(const CachedResult& res);
+
+    /** Create the temporary files to capture the output of a command
+        (see Pipeline::start).  On failure, the descriptors are -1 and
+        the command runs uncaptured.
+
+        \return The capture files.
+    */
+    OutputCapture beginCapture() const;
+
+    /** Finish a captured run: replay the captured output and save it
+        under the key.  Runs killed by a signal (exit code 128 or more)
+        or not started (exit code -1) are not saved.  The capture files
+        are closed.
+
+        \param[in] key The key of the command.
+
+        \param[in,out] capture The capture files from beginCapture.
+
+        \param[in] exitCode The exit code of the command.
+
+        \param[in] wallMs The wall time of the command.
+    */
+    void endCapture(const std::string& key, OutputCapture& capture,
+                    const int exitCode, const double wallMs);
+
+    /** Clear the hit, miss, and time-saved counters (e.g., at the start
+        of each script).
+    */
+    void resetStats();
+
+    /** Print the hit rate and the time saved since resetStats.
+
+        \param[out] os The output stream to where the statistics are
+        written.
+    */
+    void printStats(std::ostream& os) const;
+
+private:
+    /** Obtain the path of the entry for a key. */
+    std::string entryPath(const std::string& key) const;
+
+    /** The directory with the entries. */
+    std::string dir;
+    /** The lookups that found (hits) or did not find (misses) a
+        saved result since resetStats. */
+    size_t hits = 0, misses = 0;
+    /** The wall time of the runs that hits replaced, in ms. */
+    double savedMs = 0;
+};
+
+#endif
@@ -0,0 +1,168 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the Pipeline class.
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "Pipeline.h"
+
+// Operators are only recognized when they were not quoted, so the
+// stream is peeked before each token to see if it starts with a quote.
+Pipeline Pipeline::parse(const std::string& line) {
+    Pipeline pipe;
+    pipe.stages.emplace_back();
+    std::istringstream is(line);
+    for (std::string tok; is >> std::ws, !is.eof();) {
+        const bool quoted = (is.peek() == '"');
+        is >> std::quoted(tok);
+        Stage& stage = pipe.stages.back();
+        if (quoted || (tok != "|" && tok != "<" && tok != ">" &&
+                       tok != ">>")) {
+            stage.argv.push_back(tok);
+        } else if (tok == "|") {
+            if (stage.argv.empty()) {
+                throw std::runtime_error("Missing command before |: " + line);
+            }
+            pipe.stages.emplace_back();
+        } else {
+            std::string file;
+            if (!(is >> std::quoted(file))) {
+                throw std::runtime_error("Missing file after " + tok + ": " +
+                                         line);
+            }
+            if (tok == "<") {
+                stage.inFile = file;
+            } else {
+                stage.outFile = file;
+                stage.append  = (tok == ">>");
+            }
+        }
+    }
+    if (pipe.stages.back().argv.empty()) {
+        if (pipe.stages.size() > 1) {
+            throw std::runtime_error("Missing command after |: " + line);
+        }
+        pipe.stages.clear();
+    }
+    pipe.procs.resize(pipe.stages.size());
+    return pipe;
+}
+
+bool Pipeline::empty() const {
+    return stages.empty();
+}
+
+std::string Pipeline::str() const {
+    std::string ret;
+    auto append = [&ret](const std::string& word) {
+        ret += (ret.empty() ? "" : " ") + word;
+    };
+    for (size_t i = 0; (i < stages.size()); i++) {
+        if (i > 0) {
+            append("|");
+        }
+        for (const auto& arg : stages[i].argv) {
+            append(arg);
+        }
+        if (!stages[i].inFile.empty()) {
+            append("< " + stages[i].inFile);
+        }
+        if (!stages[i].outFile.empty()) {
+            append((stages[i].append ? ">> " : "> ") + stages[i].outFile);
+        }
+    }
+    return ret;
+}
+
+// Each pipe is created with O_CLOEXEC so that only the child it is
+// dup2'ed into keeps it open; the parent closes its copies right after
+// spawning so that readers see end-of-file when writers exit.
+int Pipeline::start(const int outFd, const int errFd) {
+    int started = 0, prevRead = -1;
+    for (size_t i = 0; (i < stages.size()); i++) {
+        int fds[2] = {-1, -1};
+        if (i + 1 < stages.size() && pipe2(fds, O_CLOEXEC) == -1) {
+            fds[0] = fds[1] = -1;  // Next stage will read from our stdin
+        }
+        StdIo io;
+        io.inFd    = prevRead;
+        io.inFile  = stages[i].inFile;
+        io.outFd   = (i + 1 < stages.size()) ? fds[1] : outFd;
+        io.outFile = stages[i].outFile;
+        io.append  = stages[i].append;
+        io.errFd   = errFd;
+        started   += (procs[i].spawn(stages[i].argv, io) > 0);
+
+        if (prevRead != -1) {
+            close(prevRead);
+        }
+        if (fds[1] != -1) {
+            close(fds[1]);
+        }
+        prevRead = fds[0];
+    }
+    return started;
+}
+
+const std::vector<Stage>& Pipeline::getStages() const {
+    return stages;
+}
+
+std::vector<int> Pipeline::getPids() const {
+    std::vector<int> pids;
+    for (const auto& proc : procs) {
+        if (proc.getPid() > 0) {
+            pids.push_back(proc.getPid());
+        }
+    }
+    return pids;
+}
+
+int Pipeline::wait(UsageReport* report) {
+    for (size_t i = 0; (i < procs.size()); i++) {
+        if (procs[i].getPid() > 0) {
+            procs[i].wait();
+            if (report != nullptr) {
+                report->add(stages[i].argv, procs[i].getUsage());
+            }
+        }
+    }
+    return exitCode();
+}
+
+bool Pipeline::setUsage(const int pid, const ChildUsage& usage,
+                        UsageReport* report) {
+    for (size_t i = 0; (i < procs.size()); i++) {
+        if (procs[i].getPid() == pid) {
+            procs[i].setUsage(usage);
+            if (report != nullptr) {
+                report->add(stages[i].argv, procs[i].getUsage());
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+int Pipeline::exitCode() const {
+    if (procs.empty() || procs.back().getPid() <= 0) {
+        return -1;
+    }
+    return procs.back().getUsage().exitCode;
+}
+
+double Pipeline::wallMs() const {
+    double wall = 0;
+    for (const auto& proc : procs) {
+        wall = std::max(wall, proc.getUsage().wallMs);
+    }
+    return wall;
+}
@@ -0,0 +1,140 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/**
+ * This source file contains the definition for the Pipeline class.
+ * This class runs a command line such as "sort < in.txt | uniq -c >
+ * out.txt" by wiring pipes directly between the child processes,
+ * without going through "bash -c".
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <string>
+#include <vector>
+#include "ChildProcess.h"
+#include "UsageReport.h"
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * One program in a pipeline along with its file redirections.
+ */
+struct Stage {
+    /** The command-line arguments of the program. */
+    StrVec argv;
+    /** The file named after "<" (empty if none). */
+    std::string inFile;
+    /** The file named after ">" or ">>" (empty if none). */
+    std::string outFile;
+    /** True if the output file was named after ">>". */
+    bool append = false;
+};
+
+/**
+ * A list of stages whose standard output is connected to the standard
+ * input of the next stage.  Data flows from one child to the next
+ * through a kernel pipe and is never copied through this process.
+ */
+class Pipeline {
+public:
+    /** Parse a command line into a pipeline.  Tokens are read using
+        std::quoted.  The operators "|", "<", ">", and ">>" must be
+        separated by spaces; quoted operators are treated as ordinary
+        arguments.
+
+        \param[in] line The command line to be parsed.
+
+        \return The parsed pipeline.  It is empty if line has no
+        tokens.  This method throws a std::runtime_error if the line is
+        malformed (e.g., "|" without a command on either side).
+    */
+    static Pipeline parse(const std::string& line);
+
+    /** Determine if this pipeline has any stages to run.
+
+        \return True if there are no stages.
+    */
+    bool empty() const;
+
+    /** Obtain the command line (with operators) of this pipeline for
+        printing.
+
+        \return The stages and redirections joined by spaces.
+    */
+    std::string str() const;
+
+    /** Spawn every stage of the pipeline, with pipes between adjacent
+        stages.  This method does not wait for the stages to finish.
+
+        \param[in] outFd An optional descriptor to be used as the
+        standard output of the last stage (unless it has an output
+        file).  -1 leaves stdout unchanged.
+
+        \param[in] errFd An optional descriptor to be used as the
+        standard error of every stage.  -1 leaves stderr unchanged.
+
+        \return The number of stages that were successfully started.
+    */
+    int start(const int outFd = -1, const int errFd = -1);
+
+    /** Obtain the stages of this pipeline.
+
+        \return The programs and redirections, in order.
+    */
+    const std::vector<Stage>& getStages() const;
+
+    /** Obtain the PIDs of the stages that were started.
+
+        \return The PIDs of the running (or finished) stages.
+    */
+    std::vector<int> getPids() const;
+
+    /** Wait for all the stages started by start to finish.
+
+        \param[out] report An optional report to which the resource
+        usage of each stage is added.
+
+        \return The exit code of the pipeline (see exitCode).
+    */
+    int wait(UsageReport* report = nullptr);
+
+    /** Record the usage of a stage that was reaped elsewhere (e.g.,
+        via ChildProcess::waitAny).
+
+        \param[in] pid The PID of the child process that finished.
+
+        \param[in] usage The usage returned by ChildProcess::waitAny.
+
+        \param[out] report An optional report to which the usage is
+        added.
+
+        \return True if pid belongs to a stage of this pipeline.
+    */
+    bool setUsage(const int pid, const ChildUsage& usage,
+                  UsageReport* report = nullptr);
+
+    /** Obtain the exit code of the pipeline, which (as in bash) is
+        the exit code of the last stage.
+
+        \return The exit code of the last stage, or -1 if it could not
+        be started.
+    */
+    int exitCode() const;
+
+    /** Obtain the elapsed time of the pipeline.
+
+        \return The longest wall time among the stages, in ms.
+    */
+    double wallMs() const;
+
+private:
+    /** The programs in this pipeline, in order. */
+    std::vector<Stage> stages;
+    /** The child process running each stage (parallel to stages). */
+    std::vector<ChildProcess> procs;
+};
+
+#endif
@@ -0,0 +1,111 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the ScriptCache class.
+ *
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "ScriptCache.h"
+
+namespace {
+
+/** The first bytes of every entry, and the entry format version. */
+const char EntryMagic[4] = {'H', 'W', '4', 'S'};
+const uint32_t EntryVersion = 1;
+
+/**
+ * Helper method to write a string preceded by its length.
+ */
+void writeString(std::ostream& os, const std::string& str) {
+    const uint64_t len = str.size();
+    os.write(reinterpret_cast<const char*>(&len), sizeof(len));
+    os.write(str.data(), str.size());
+}
+
+/**
+ * Helper method to read a string written by writeString.
+ */
+bool readString(std::istream& is, std::string& str) {
+    uint64_t len = 0;
+    if (!is.read(reinterpret_cast<char*>(&len), sizeof(len))) {
+        return false;
+    }
+    str.resize(len);
+    return len == 0 || is.read(&str[0], len);
+}
+
+}  // namespace
+
+ScriptCache::ScriptCache(const std::string& dir) : dir(dir) {
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        throw std::runtime_error("Unable to create cache directory " + dir);
+    }
+}
+
+// Entries are named by a 64-bit FNV-1a hash of the URL.  The URL is
+// saved in the entry too, so that a collision is just a miss.
+std::string ScriptCache::entryPath(const std::string& url) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char c : url) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    std::ostringstream path;
+    path << dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << hash << ".script";
+    return path.str();
+}
+
+bool ScriptCache::lookup(const std::string& url, ScriptEntry& entry) const {
+    std::ifstream is(entryPath(url), std::ios::binary);
+    char magic[4];
+    uint32_t version = 0;
+    ScriptEntry saved;
+    if (is.read(magic, 4) && std::equal(magic, magic + 4, EntryMagic) &&
+        is.read(reinterpret_cast<char*>(&version), sizeof(version)) &&
+        version == EntryVersion && readString(is, saved.url) &&
+        saved.url == url && readString(is, saved.etag) &&
+        readString(is, saved.lastModified) && readString(is, saved.body)) {
+        entry = saved;
+        return true;
+    }
+    return false;
+}
+
+// The entry is written to a temporary name and renamed, so that a
+// concurrent shell never reads a partial entry.
+void ScriptCache::store(const ScriptEntry& entry) const {
+    if (entry.etag.empty() && entry.lastModified.empty()) {
+        return;
+    }
+    const std::string path = entryPath(entry.url);
+    const std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream os(tmpPath, std::ios::binary);
+        os.write(EntryMagic, 4);
+        os.write(reinterpret_cast<const char*>(&EntryVersion),
+                 sizeof(EntryVersion));
+        writeString(os, entry.url);
+        writeString(os, entry.etag);
+        writeString(os, entry.lastModified);
+        writeString(os, entry.body);
+        if (!os.good()) {
+            os.close();
+            unlink(tmpPath.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+    }
+}
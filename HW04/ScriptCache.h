@@ -0,0 +1,74 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+/**
+ * This source file contains the definition for the ScriptCache class.
+ * This class keeps copies of downloaded job scripts on disk, along with
+ * the validators (ETag and Last-Modified) the web-server sent, so that
+ * a script that has not changed does not need to be downloaded again.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <string>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A downloaded script and the headers needed to revalidate it.
+ */
+struct ScriptEntry {
+    /** The URL the script was downloaded from. */
+    std::string url;
+    /** The ETag and Last-Modified headers of the response (empty if
+        the web-server did not send them). */
+    std::string etag, lastModified;
+    /** The body of the response, i.e., the script. */
+    std::string body;
+};
+
+/**
+ * A cache of scripts in a directory, with one file per URL.  An entry
+ * is only used after the web-server confirms (with a 304 response to a
+ * conditional request) that the script has not changed.
+ */
+class ScriptCache {
+public:
+    /** The constructor.
+
+        \param[in] dir The directory for the entries.  It is created if
+        it does not exist.  A std::runtime_error is thrown if it cannot
+        be created.
+    */
+    explicit ScriptCache(const std::string& dir);
+
+    /** Look up the saved copy of a script.
+
+        \param[in] url The URL of the script.
+
+        \param[out] entry The saved copy, if any.
+
+        \return True if a copy was found.
+    */
+    bool lookup(const std::string& url, ScriptEntry& entry) const;
+
+    /** Save a copy of a script, replacing any earlier copy.  Entries
+        without an ETag or Last-Modified header are not saved, since
+        they could never be revalidated.  Errors (e.g., a full disk) are
+        ignored; they only cost a future download.
+
+        \param[in] entry The script to be saved.
+    */
+    void store(const ScriptEntry& entry) const;
+
+private:
+    /** Obtain the path of the entry for a URL. */
+    std::string entryPath(const std::string& url) const;
+
+    /** The directory with the entries. */
+    std::string dir;
+};
+
+#endif
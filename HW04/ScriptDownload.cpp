@@ -0,0 +1,254 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the ScriptDownload class.
+ *
+ */
+
+#include <poll.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include "ScriptDownload.h"
+
+namespace {
+
+/**
+ * Helper method to split a URL of the form "http://host[:port]/path"
+ * into its parts.
+ *
+ * @return False if the URL is malformed.
+ */
+bool parseUrl(const std::string& url, std::string& host, std::string& port,
+              std::string& path) {
+    const size_t start = url.find("//");
+    if (start == std::string::npos) {
+        return false;
+    }
+    const size_t slash = url.find('/', start + 2);
+    const std::string hostPort = url.substr(start + 2, slash - start - 2);
+    path = (slash == std::string::npos) ? "/" : url.substr(slash);
+    const size_t colon = hostPort.find(':');
+    host = hostPort.substr(0, colon);
+    port = (colon == std::string::npos) ? "80" : hostPort.substr(colon + 1);
+    return !host.empty() && !port.empty();
+}
+
+/**
+ * Helper method to remove leading and trailing white space.
+ */
+std::string trim(const std::string& str) {
+    const size_t begin = str.find_first_not_of(" \t\r");
+    const size_t end = str.find_last_not_of(" \t\r");
+    return (begin == std::string::npos) ? "" :
+        str.substr(begin, end - begin + 1);
+}
+
+/**
+ * Helper method to compare header names, which are case-insensitive.
+ */
+bool sameName(const std::string& name, const std::string& expected) {
+    return name.size() == expected.size() &&
+        std::equal(name.begin(), name.end(), expected.begin(),
+                   [](const char a, const char b) {
+                       return std::tolower(a) == std::tolower(b);
+                   });
+}
+
+}  // namespace
+
+ScriptDownload::ScriptDownload(const std::string& url,
+                               const ScriptCache* cache) :
+    socket(io), cache(cache) {
+    std::string host, port, path;
+    if (!parseUrl(url, host, port, path)) {
+        throw std::runtime_error("Invalid URL " + url);
+    }
+    entry.url = url;
+    haveSaved = (cache != nullptr) && cache->lookup(url, saved);
+
+    boost::asio::ip::tcp::resolver resolver(io);
+    boost::asio::connect(socket, resolver.resolve(host, port));
+    std::ostringstream req;
+    req << "GET "   << path << " HTTP/1.1\r\n"
+        << "Host: " << host << (port == "80" ? "" : ":" + port) << "\r\n";
+    if (haveSaved && !saved.etag.empty()) {
+        req << "If-None-Match: " << saved.etag << "\r\n";
+    }
+    if (haveSaved && !saved.lastModified.empty()) {
+        req << "If-Modified-Since: " << saved.lastModified << "\r\n";
+    }
+    req << "Connection: Close\r\n\r\n";
+    boost::asio::write(socket, boost::asio::buffer(req.str()));
+    socket.non_blocking(true);
+    sockFd = socket.native_handle();
+}
+
+int ScriptDownload::fd() const {
+    return (state == Done) ? -1 : sockFd;
+}
+
+bool ScriptDownload::done() const {
+    return state == Done;
+}
+
+bool ScriptDownload::fromCache() const {
+    return notModified;
+}
+
+void ScriptDownload::pump() {
+    char buf[65536];
+    while (state != Done) {
+        boost::system::error_code ec;
+        const size_t n = socket.read_some(boost::asio::buffer(buf), ec);
+        if (ec == boost::asio::error::would_block ||
+            ec == boost::asio::error::try_again ||
+            ec == boost::asio::error::interrupted) {
+            return;
+        }
+        if (ec) {
+            // Closed (or failed): only a body that runs to the end of
+            // the connection is complete now.
+            finish(state == Body && remaining == -1);
+            return;
+        }
+        raw.append(buf, n);
+        decode();
+    }
+}
+
+bool ScriptDownload::nextLine(std::string& line) {
+    const size_t end = entry.body.find('\n', lineStart);
+    if (end != std::string::npos) {
+        line = entry.body.substr(lineStart, end - lineStart);
+        lineStart = end + 1;
+        return true;
+    }
+    if (state == Done && !bodyComplete) {
+        // A cut-off line (e.g., "rm -rf /" of "rm -rf /tmp/build") must
+        // never be run, so the partial line is dropped.
+        lineStart = entry.body.size();
+        throw std::runtime_error("Incomplete download: " + entry.url);
+    }
+    if (state == Done && lineStart < entry.body.size()) {
+        line = entry.body.substr(lineStart);
+        lineStart = entry.body.size();
+        return true;
+    }
+    return false;
+}
+
+bool ScriptDownload::getline(std::string& line) {
+    while (!nextLine(line)) {
+        if (state == Done) {
+            return false;
+        }
+        pollfd pfd = {fd(), POLLIN, 0};
+        poll(&pfd, 1, -1);
+        pump();
+    }
+    return true;
+}
+
+// The body is moved from raw into entry.body as far as the framing
+// (Content-Length or chunks) allows, so that lines become available as
+// soon as they arrive.
+void ScriptDownload::decode() {
+    for (bool progress = true; progress && state != Done;) {
+        progress = false;
+        if (state == Headers) {
+            const size_t pos = raw.find("\r\n\r\n");
+            if (pos != std::string::npos) {
+                parseHeaders(pos);
+                progress = true;
+            }
+        } else if (state == Body || state == ChunkData) {
+            const size_t n = (remaining < 0) ? raw.size() :
+                std::min<size_t>(raw.size(), remaining);
+            entry.body.append(raw, 0, n);
+            raw.erase(0, n);
+            if (remaining >= 0) {
+                remaining -= n;
+            }
+            if (remaining == 0) {
+                if (state == Body) {
+                    finish(true);
+                } else {
+                    state = ChunkEnd;
+                    progress = true;
+                }
+            }
+        } else if (state == ChunkEnd && raw.size() >= 2) {
+            raw.erase(0, 2);  // The CRLF after the chunk data
+            state = ChunkSize;
+            progress = true;
+        } else if (state == ChunkSize) {
+            const size_t pos = raw.find("\r\n");
+            if (pos != std::string::npos) {
+                remaining = std::strtoll(raw.c_str(), nullptr, 16);
+                raw.erase(0, pos + 2);
+                if (remaining <= 0) {
+                    finish(true);  // The last chunk (trailers ignored)
+                } else {
+                    state = ChunkData;
+                    progress = true;
+                }
+            }
+        }
+    }
+}
+
+void ScriptDownload::parseHeaders(const size_t pos) {
+    std::istringstream is(raw.substr(0, pos));
+    raw.erase(0, pos + 4);
+    std::string line, version;
+    std::getline(is, line);
+    std::istringstream(line) >> version >> status;
+    if ((status < 200 || status > 299) && status != 304) {
+        // E.g., a 404 page, which must not be run as commands.
+        finish(false);
+        throw std::runtime_error("HTTP status " + std::to_string(status) +
+                                 " for " + entry.url);
+    }
+    state = Body;
+    while (std::getline(is, line)) {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        const std::string name = line.substr(0, colon);
+        const std::string value = trim(line.substr(colon + 1));
+        if (sameName(name, "ETag")) {
+            entry.etag = value;
+        } else if (sameName(name, "Last-Modified")) {
+            entry.lastModified = value;
+        } else if (sameName(name, "Content-Length")) {
+            remaining = std::strtoll(value.c_str(), nullptr, 10);
+        } else if (sameName(name, "Transfer-Encoding") &&
+                   value.find("chunked") != std::string::npos) {
+            state = ChunkSize;
+        }
+    }
+    if (status == 304 && haveSaved) {
+        entry.body = saved.body;
+        notModified = true;
+        finish(true);  // Complete, but only a 200 is saved
+    } else if (status == 304 || status == 204 ||
+               (state == Body && remaining == 0)) {
+        finish(true);
+    }
+}
+
+void ScriptDownload::finish(const bool complete) {
+    state = Done;
+    bodyComplete = complete;
+    boost::system::error_code ec;
+    socket.close(ec);
+    if (complete && status == 200 && cache != nullptr) {
+        cache->store(entry);
+    }
+}
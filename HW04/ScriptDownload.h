@@ -0,0 +1,132 @@
+#ifndef SCRIPT_DOWNLOAD_H
+#define SCRIPT_DOWNLOAD_H
+
+/**
+ * This source file contains the definition for the ScriptDownload
+ * class.  This class downloads a job script over HTTP and hands it out
+ * line by line as it arrives, so that the first commands can be run
+ * while the rest of the script is still being downloaded.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <boost/asio.hpp>
+#include <string>
+#include "ScriptCache.h"
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A single download of a script from a URL of the form
+ * "http://host[:port]/path".  The response is read without blocking
+ * (see pump) and its body is decoded (plain or chunked) into lines.
+ *
+ * If a cache is given and it has a copy of the script, the request is
+ * made conditional (If-None-Match and If-Modified-Since); a 304
+ * response then delivers the saved copy.  A complete 200 response is
+ * saved in the cache.
+ */
+class ScriptDownload {
+public:
+    /** The constructor connects to the web-server and sends the
+        request.  A std::runtime_error is thrown if the URL is malformed
+        or the connection fails.
+
+        \param[in] url The URL of the script.
+
+        \param[in] cache An optional cache of scripts.
+    */
+    explicit ScriptDownload(const std::string& url,
+                            const ScriptCache* cache = nullptr);
+
+    /** Obtain the descriptor of the connection, for poll.
+
+        \return The descriptor, or -1 once the download is done.
+    */
+    int fd() const;
+
+    /** Read and decode the data that has arrived, without blocking.
+        A std::runtime_error is thrown if the response status is
+        neither 2xx nor 304 (Not Modified).
+    */
+    void pump();
+
+    /** Obtain the next line of the script, without blocking.
+
+        \param[out] line The line (without the newline).  The last line
+        is returned once the download is done, even without a newline,
+        provided the whole body was received.
+
+        \return False if no complete line has arrived (yet).  A
+        std::runtime_error is thrown once the lines that did arrive
+        whole are used up, if the connection was closed before the
+        whole body (per Content-Length or chunks) arrived; the partial
+        last line is dropped.
+    */
+    bool nextLine(std::string& line);
+
+    /** Obtain the next line of the script, waiting for it to arrive.
+
+        \param[out] line The line (without the newline).
+
+        \return False at the end of the script.  A std::runtime_error
+        is thrown as for pump and nextLine.
+    */
+    bool getline(std::string& line);
+
+    /** Determine if the whole response has been received (or the
+        connection was closed).
+
+        \return True if the download is done.
+    */
+    bool done() const;
+
+    /** Determine if the script is the saved copy from the cache.
+
+        \return True if the web-server reported it as not modified.
+    */
+    bool fromCache() const;
+
+private:
+    /** The parts of the response being received. */
+    enum State { Headers, Body, ChunkSize, ChunkData, ChunkEnd, Done };
+
+    /** Decode the data in raw, as far as it is complete. */
+    void decode();
+
+    /** Parse the status line and headers in raw (up to the blank
+        line at pos). */
+    void parseHeaders(const size_t pos);
+
+    /** End the download, saving the script if it is complete (and
+        the response was a 200). */
+    void finish(const bool complete);
+
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::socket socket;
+    /** The descriptor of the socket (see fd). */
+    int sockFd = -1;
+    /** The cache, if any, and its copy of the script. */
+    const ScriptCache* cache;
+    ScriptEntry saved;
+    bool haveSaved = false;
+    /** The script (body) received so far with its validators. */
+    ScriptEntry entry;
+    /** Data received but not yet decoded. */
+    std::string raw;
+    State state = Headers;
+    /** The HTTP status code of the response. */
+    int status = 0;
+    /** The body bytes left in the response or chunk (-1 if the body
+        ends when the connection is closed). */
+    long long remaining = -1;
+    /** The offset in entry.body of the first line not handed out. */
+    size_t lineStart = 0;
+    bool notModified = false;
+    /** True if the whole body was received (see finish). */
+    bool bodyComplete = false;
+};
+
+#endif
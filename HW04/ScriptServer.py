@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright Brendan Han 2023
+
+"""
+A local stand-in for the web-server that HW04 downloads job scripts
+from, for testing ScriptDownload and ScriptCache without a network.
+The files in the current directory are served with ETag and
+Last-Modified headers, and conditional requests (If-None-Match) are
+answered with 304.  Query parameters change the response:
+
+  ?delay=S     sends the body one line every S seconds (streaming)
+  ?chunked=1   sends the body with chunked transfer encoding
+  ?status=N    sends an HTML error page with status N instead
+  ?cut=N       closes the connection after N bytes of the body, as
+               if it were cut off (the headers announce all of it)
+
+A missing file is a 404 with an HTML error page.
+
+Usage: python3 ScriptServer.py <port>
+"""
+
+import email.utils
+import hashlib
+import http.server
+import os
+import sys
+import time
+import urllib.parse
+
+
+class ScriptHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def send_error_page(self, status):
+        page = b"<html><body>Error %d</body></html>\n" % status
+        self.send_response(status)
+        self.send_header("Content-Type", "text/html")
+        self.send_header("Content-Length", str(len(page)))
+        self.end_headers()
+        self.wfile.write(page)
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = urllib.parse.parse_qs(url.query)
+        if "status" in query:
+            self.send_error_page(int(query["status"][0]))
+            return
+        path = url.path.lstrip("/")
+        try:
+            with open(path, "rb") as script:
+                body = script.read()
+        except OSError:
+            self.send_error_page(404)
+            return
+        etag = '"%s"' % hashlib.sha1(body).hexdigest()[:16]
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.end_headers()
+            return
+        chunked = "chunked" in query
+        self.send_response(200)
+        self.send_header("ETag", etag)
+        self.send_header("Last-Modified", email.utils.formatdate(
+            os.stat(path).st_mtime, usegmt=True))
+        if chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        delay = float(query.get("delay", ["0"])[0])
+        cut = int(query.get("cut", [len(body)])[0])
+        for line in body.splitlines(True):
+            part = line[:max(0, cut)]
+            cut -= len(line)
+            if chunked:
+                # A cut-off chunk still announces its full size.
+                self.wfile.write(b"%x\r\n%s" % (len(line), part))
+                if cut >= 0:
+                    self.wfile.write(b"\r\n")
+            else:
+                self.wfile.write(part)
+            self.wfile.flush()
+            if cut < 0:
+                self.close_connection = True
+                return
+            time.sleep(delay)
+        if chunked:
+            self.wfile.write(b"0\r\n\r\n")
+
+
+if __name__ == "__main__":
+    http.server.ThreadingHTTPServer(
+        ("127.0.0.1", int(sys.argv[1])), ScriptHandler).serve_forever()
@@ -0,0 +1,158 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the UsageReport class.
+ *
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include "UsageReport.h"
+
+namespace {
+
+/**
+ * Helper method to escape a string for use inside double quotes in
+ * JSON output.
+ *
+ * @param str The string to be escaped.
+ *
+ * @return The escaped string (without the surrounding quotes).
+ */
+std::string jsonEscape(const std::string& str) {
+    std::ostringstream os;
+    for (const unsigned char c : str) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (c < 0x20) {
+            os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+               << static_cast<int>(c) << std::dec << std::setfill(' ');
+        } else {
+            os << c;
+        }
+    }
+    return os.str();
+}
+
+/**
+ * Helper method to quote a string for use as a CSV field.  Embedded
+ * double quotes are doubled, as per RFC 4180.
+ *
+ * @param str The string to be quoted.
+ *
+ * @return The quoted string.
+ */
+std::string csvQuote(const std::string& str) {
+    std::string ret = "\"";
+    for (const char c : str) {
+        ret += (c == '"') ? "\"\"" : std::string(1, c);
+    }
+    return ret + "\"";
+}
+
+}  // namespace
+
+void UsageReport::add(const StrVec& cmd, const ChildUsage& usage) {
+    std::string line;
+    for (const auto& arg : cmd) {
+        line += (line.empty() ? "" : " ") + arg;
+    }
+    cmds.push_back(line);
+    usages.push_back(usage);
+}
+
+// Totals first, then per-command aggregates sorted by CPU time.
+void UsageReport::printSummary(std::ostream& os, const size_t top) const {
+    ChildUsage total;
+    int failed = 0;
+    std::unordered_map<std::string, std::pair<int, ChildUsage>> byCmd;
+    StrVec order;  // first-seen order of each distinct command
+    for (size_t i = 0; (i < usages.size()); i++) {
+        const ChildUsage& u = usages[i];
+        failed += (u.exitCode != 0);
+        total.wallMs += u.wallMs;
+        total.userMs += u.userMs;
+        total.sysMs  += u.sysMs;
+        total.maxRssKb = std::max(total.maxRssKb, u.maxRssKb);
+        total.minorFaults += u.minorFaults;
+        total.majorFaults += u.majorFaults;
+        total.volCtxSwitches += u.volCtxSwitches;
+        total.invCtxSwitches += u.invCtxSwitches;
+
+        auto& entry = byCmd[cmds[i]];
+        if (entry.first++ == 0) {
+            order.push_back(cmds[i]);
+        }
+        entry.second.wallMs += u.wallMs;
+        entry.second.userMs += u.userMs;
+        entry.second.sysMs  += u.sysMs;
+        entry.second.maxRssKb = std::max(entry.second.maxRssKb, u.maxRssKb);
+        entry.second.majorFaults += u.majorFaults;
+        entry.second.minorFaults += u.minorFaults;
+    }
+
+    const auto flags = os.flags();
+    const auto precision = os.precision();
+    os << std::fixed << std::setprecision(1);
+    os << "Children: " << usages.size() << " (" << failed << " failed)\n"
+       << "Total wall: " << total.wallMs << " ms, user: " << total.userMs
+       << " ms, sys: " << total.sysMs << " ms\n"
+       << "Peak RSS: " << total.maxRssKb << " KB, page faults: "
+       << total.minorFaults << " minor / " << total.majorFaults
+       << " major, context switches: " << total.volCtxSwitches
+       << " voluntary / " << total.invCtxSwitches << " involuntary\n";
+
+    auto cpu = [&](const std::string& cmd) {
+        const ChildUsage& u = byCmd.at(cmd).second;
+        return u.userMs + u.sysMs;
+    };
+    std::stable_sort(order.begin(), order.end(),
+                     [&](const std::string& a, const std::string& b) {
+                         return cpu(a) > cpu(b); });
+    if (order.size() > top) {
+        order.resize(top);
+    }
+    os << "Top commands by CPU time (runs, cpu ms, wall ms, peak KB):\n";
+    for (const auto& cmd : order) {
+        const auto& entry = byCmd.at(cmd);
+        os << std::setw(6) << entry.first << std::setw(12) << cpu(cmd)
+           << std::setw(12) << entry.second.wallMs << std::setw(10)
+           << entry.second.maxRssKb << "  " << cmd << '\n';
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void UsageReport::writeCsv(std::ostream& os) const {
+    os << "command,exit_code,wall_ms,user_ms,sys_ms,max_rss_kb,"
+       << "minor_faults,major_faults,vol_ctx_switches,inv_ctx_switches\n";
+    for (size_t i = 0; (i < usages.size()); i++) {
+        const ChildUsage& u = usages[i];
+        os << csvQuote(cmds[i]) << ',' << u.exitCode << ',' << u.wallMs
+           << ',' << u.userMs << ',' << u.sysMs << ',' << u.maxRssKb << ','
+           << u.minorFaults << ',' << u.majorFaults << ','
+           << u.volCtxSwitches << ',' << u.invCtxSwitches << '\n';
+    }
+}
+
+void UsageReport::writeJson(std::ostream& os) const {
+    os << "[";
+    for (size_t i = 0; (i < usages.size()); i++) {
+        const ChildUsage& u = usages[i];
+        os << (i ? ",\n " : "\n ")
+           << "{\"command\": \"" << jsonEscape(cmds[i]) << "\", "
+           << "\"exit_code\": " << u.exitCode << ", "
+           << "\"wall_ms\": " << u.wallMs << ", "
+           << "\"user_ms\": " << u.userMs << ", "
+           << "\"sys_ms\": " << u.sysMs << ", "
+           << "\"max_rss_kb\": " << u.maxRssKb << ", "
+           << "\"minor_faults\": " << u.minorFaults << ", "
+           << "\"major_faults\": " << u.majorFaults << ", "
+           << "\"vol_ctx_switches\": " << u.volCtxSwitches << ", "
+           << "\"inv_ctx_switches\": " << u.invCtxSwitches << "}";
+    }
+    os << "\n]\n";
+}
@@ -0,0 +1,66 @@
+#ifndef USAGE_REPORT_H
+#define USAGE_REPORT_H
+
+/**
+ * This source file contains the definition for the UsageReport
+ * class.  This class accumulates the resources used by every child
+ * process run by the shell and reports or exports them.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ChildProcess.h"
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A simple class to record the command-line and ChildUsage of each
+ * child process and to summarize them, so that the commands which
+ * dominate the cost of a job script can be identified.
+ */
+class UsageReport {
+public:
+    /** Record the usage of one finished child process.
+
+        \param[in] cmd The command-line that was run.
+
+        \param[in] usage The resources used by the child process.
+    */
+    void add(const StrVec& cmd, const ChildUsage& usage);
+
+    /** Print the totals over all recorded children followed by the
+        commands with the highest total CPU time (user + sys).  Runs of
+        identical command-lines are combined.
+
+        \param[out] os The output stream to where the summary is to be
+        written.
+
+        \param[in] top The maximum number of commands to be listed.
+    */
+    void printSummary(std::ostream& os, const size_t top = 10) const;
+
+    /** Write one CSV row (with a header row) per recorded child.
+
+        \param[out] os The output stream to where the CSV is written.
+    */
+    void writeCsv(std::ostream& os) const;
+
+    /** Write a JSON array with one object per recorded child.
+
+        \param[out] os The output stream to where the JSON is written.
+    */
+    void writeJson(std::ostream& os) const;
+
+private:
+    /** The command-line of each recorded child, joined by spaces. */
+    StrVec cmds;
+    /** The usage of each recorded child (parallel to cmds). */
+    std::vector<ChildUsage> usages;
+};
+
+#endif
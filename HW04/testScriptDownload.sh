@@ -0,0 +1,97 @@
+#!/bin/bash
+# Copyright Brendan Han 2023
+#
+# Checks the script downloads of HW04 (ScriptDownload, ScriptCache and
+# the streaming JobScheduler) against the local stand-in web-server in
+# ScriptServer.py.  The checks are: plain, chunked and streamed scripts
+# are run; error responses (404, 500) are reported and not run; cached
+# scripts are revalidated; a cut-off download is reported and its
+# partial last line is not run; and a malformed line in the middle of
+# a PARALLEL download does not leak descriptors.
+#
+# Usage (from the top-level directory, with HW04 built as ./hw04):
+#   HW04/testScriptDownload.sh ./hw04 [port]
+
+hw04=$(realpath "${1:?Usage: $0 <hw04 binary> [port]}")
+port=${2:-8404}
+here=$(dirname "$(realpath "$0")")
+dir=$(mktemp -d)
+trap 'kill $server 2> /dev/null; rm -rf "$dir"' EXIT
+url="http://127.0.0.1:$port"
+failures=0
+
+cd "$dir" || exit 1
+printf 'JOB a RUN echo alpha\nJOB b AFTER a RUN echo beta\n' > ok.txt
+printf 'JOB a RUN sleep 0.5\nJOB b RUN sleep 0.5\nJOB c AFTER\n' > bad.txt
+# A script cut off mid-line: its prefix "touch partial" is a command.
+first='JOB a RUN echo first'
+prefix='JOB b RUN touch partial'
+printf '%s\n%s_run_not\n' "$first" "$prefix" > cut.txt
+cut=$((${#first} + 1 + ${#prefix}))
+python3 "$here/ScriptServer.py" "$port" &
+server=$!
+for i in $(seq 50); do
+    (exec 3<> "/dev/tcp/127.0.0.1/$port") 2> /dev/null && break
+    sleep 0.1
+done
+
+# Runs hw04 on the commands in $1 and checks that its output matches
+# the extended regular expression $3 (or does not, if $2 is "!").
+check() {
+    local output
+    output=$(printf '%s\nexit\n' "$1" | "$hw04" 2>&1)
+    if echo "$output" | grep -Eq "$3"; then
+        [ "$2" = "!" ] && local failed=1
+    else
+        [ "$2" = "!" ] || local failed=1
+    fi
+    if [ -n "$failed" ]; then
+        echo "FAIL: $1 (expected $2 /$3/)"
+        echo "$output" | sed 's/^/    /'
+        failures=$((failures + 1))
+    else
+        echo "ok: $1 ($2 /$3/)"
+    fi
+}
+
+check "SERIAL $url/ok.txt" "=" "beta"
+check "PARALLEL $url/ok.txt?chunked=1" "=" "beta"
+check "PARALLEL $url/ok.txt?delay=0.2" "=" "beta"
+check "SERIAL $url/missing.txt" "=" "Error: HTTP status 404"
+check "SERIAL $url/ok.txt?status=500" "=" "Error: HTTP status 500"
+check "PARALLEL $url/ok.txt?status=500" "!" "html|Running"
+check "CACHE cache
+SERIAL $url/ok.txt
+SERIAL $url/ok.txt" "=" "beta"
+[ -n "$(ls cache/scripts 2> /dev/null)" ] ||
+    { echo "FAIL: no script was cached"; failures=$((failures + 1)); }
+
+# A download cut off mid-line (under Content-Length and chunked) is
+# an error, and the partial line is never run.
+for query in "cut=$cut" "cut=$cut&chunked=1"; do
+    for task in SERIAL PARALLEL; do
+        check "$task $url/cut.txt?$query" "=" "Error: Incomplete download"
+        if [ -e partial ]; then
+            echo "FAIL: the partial line of $task $query was run"
+            failures=$((failures + 1))
+            rm -f partial
+        fi
+    done
+done
+
+# The descriptors of hw04 (the parent of sh) before and after a
+# download that fails while jobs are running.
+fds='sh -c "ls /proc/\$PPID/fd | wc -l"'
+output=$(printf '%s\nPARALLEL %s\n%s\nexit\n' "$fds" \
+    "$url/bad.txt?delay=0.2" "$fds" | "$hw04" 2>&1)
+counts=$(echo "$output" | grep -E '^[0-9]+$' | uniq | wc -l)
+if ! echo "$output" | grep -q "JOB without a RUN" || [ "$counts" != 1 ]; then
+    echo "FAIL: descriptors leaked by a malformed PARALLEL script"
+    echo "$output" | sed 's/^/    /'
+    failures=$((failures + 1))
+else
+    echo "ok: no descriptors leaked by a malformed PARALLEL script"
+fi
+
+echo "$failures failure(s)"
+[ "$failures" = 0 ]
@@ -15,12 +15,110 @@
 #include <cmath>
 #include <utility>
 #include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
 #include "hw5.h"
+#include "Factorization.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include "TopK.h"
+#include "WideFactorization.h"
 
 BigInt factorize(const BigInt& num);
 
+/** The longest line formatResult writes: three 20-digit numbers and
+ * the fixed text " = ", " (prime) * ", " (prime)".
+ */
+const size_t MaxResultLen = 3 * 20 + 3 + 11 + 8;
+
+/** The facts about a number that are reported for it. */
+struct FactorResult {
+    BigInt num;         // The number itself
+    BigInt smallest;    // Its smallest prime factor
+    bool prime;         // True if num is prime
+    bool otherPrime;    // True if num / smallest is prime
+};
+
+/** Helper method to factorize a number without allocating memory.
+ *
+ * \param[in] num The number to be factorized.
+ *
+ * \return The smallest factor and primality information for num.
+ */
+FactorResult computeResult(const BigInt num) {
+    METRIC_TIMER("hw05_factor_seconds{width=\"64\"}",
+                 "Time to factor one number.");
+    METRIC_COUNT("hw05_numbers_total{width=\"64\"}", "Numbers factored.", 1);
+    uint64_t factors[MaxFactors];
+    const size_t count = primeFactors(num, factors);
+    if (count == 0) {
+        // 0 and 1 have no prime factors; keep the original behavior
+        const BigInt smallestDiv = factorize(num);
+        return {num, smallestDiv, false, isPrime(num / smallestDiv)};
+    }
+    return {num, factors[0], count == 1, count == 2};
+}
+
+/** Helper method to write the line reported for a number into a
+ * buffer, without allocating memory.
+ *
+ * \param[in] res The result to be formatted.
+ *
+ * \param[out] buf The buffer to write to.  It must have room for
+ * MaxResultLen characters.  No '\0' is appended.
+ *
+ * \return The number of characters written.
+ */
+size_t formatResult(const FactorResult& res, char* buf) {
+    auto append = [&](char* pos, const char* text) {
+        const size_t len = std::strlen(text);
+        std::memcpy(pos, text, len);
+        return pos + len;
+    };
+    char* pos = std::to_chars(buf, buf + 20, res.num).ptr;
+    if (res.prime) {
+        pos = append(pos, ": Is already prime.");
+    } else {
+        pos = append(pos, " = ");
+        pos = std::to_chars(pos, pos + 20, res.smallest).ptr;
+        pos = append(pos, " (prime) * ");
+        pos = std::to_chars(pos, pos + 20, res.num / res.smallest).ptr;
+        if (res.otherPrime) {
+            pos = append(pos, " (prime)");
+        }
+    }
+    return pos - buf;
+}
+
+/** Helper method to factorize a range of numbers and append the result
+ * lines (each followed by a newline) to a single buffer.  This needs
+ * at most one allocation per range rather than several per number.
+ *
+ * \param[in] first The first number to be factorized.
+ *
+ * \param[in] last One past the last number to be factorized.
+ *
+ * \param[out] out The buffer to which the lines are appended.
+ */
+void formatRange(const BigInt* first, const BigInt* last, std::string& out) {
+    const size_t start = out.size();
+    out.resize(start + (last - first) * (MaxResultLen + 1));
+    char* pos = &out[start];
+    for (; first < last; first++) {
+        pos += formatResult(computeResult(*first), pos);
+        *pos++ = '\n';
+    }
+    out.resize(pos - out.data());
+}
+
 /** A data parallel method to count the factors for a given list of
- * values using multiple threads.
+ * values using multiple threads.  The factors are obtained from the
+ * Miller-Rabin/Pollard-Brent engine in Factorization.h, which is much
+ * faster than trial division for numbers with large prime factors.
  *
  * \param[in] numList The list of numbers whose factor counts are to
  * be computed.
@@ -29,25 +127,15 @@ BigInt factorize(const BigInt& num);
  *
  */
 void threadMain(const BigIntVec& numList, std::string& answer, int thr) {
-    answer = "";
-
-    // Checking first to see if the number is prime
-    if (isPrime(numList[thr])) {
-        answer = std::to_string(numList[thr]) + ": Is already prime.";
-    } else {
-        BigInt smallestDiv = factorize(numList[thr]);
-        BigInt otherFactor = numList[thr] / smallestDiv;
-
-        // Formulating a response to be store in the vector
-        answer =  std::to_string(numList[thr]) + " = " +
-        std::to_string(smallestDiv) + " (prime) * " +
-        std::to_string(otherFactor) +
-        (isPrime(otherFactor) ? " (prime)" : "");
-    }
+    char buf[MaxResultLen];
+    answer.assign(buf, formatResult(computeResult(numList[thr]), buf));
 }
 
 /** A data parallel method to count the factors for a given list of
- * values using multiple threads.
+ * values using multiple threads.  The numbers are processed by the
+ * shared, hardware-sized ThreadPool (rather than one thread per
+ * number).  Since the cost of factoring varies wildly from number to
+ * number, idle workers steal chunks from busy ones.
  *
  * \param[in] numVec The list of numbers whose factor counts are to
  * be computed.
@@ -56,122 +144,238 @@ void threadMain(const BigIntVec& numList, std::string& answer, int thr) {
  */
 StrVec factorize(const BigIntVec& numVec) {
     // First allocate the return vector
-    int thrCount = numVec.size();
     StrVec factCounts(numVec.size());
-    
-    // Compute the range of values each thread should iterate over.
-    // const int count = (numVec.size() + thrCount - 1) / thrCount;
-    // Now spin-up threads to do the work.
-    std::vector<std::thread> thrList(thrCount);
-    for (int thr = 0; (thr < thrCount); thr++) {
-        // const size_t start = thr * count;
-        // const size_t end = std::min(numVec.size(), start + count);
-
-        thrList[thr] = (std::thread(threadMain, std::ref(numVec),
-        std::ref(factCounts[thr]), thr));
-    }
 
-    // Wait for all of the threads to finish.
-    for (auto& t : thrList) {
-        t.join();
-    }
+    // Small chunks let idle workers steal the remaining easy numbers
+    // while another worker is stuck on a hard one.
+    ThreadPool& pool = ThreadPool::instance();
+    const size_t grain = std::max<size_t>(1, numVec.size() /
+                                          (pool.size() * 32));
+    pool.parallelFor(numVec.size(), grain, [&](size_t start, size_t end) {
+        for (size_t i = start; (i < end); i++) {
+            threadMain(numVec, factCounts[i], i);
+        }
+    });
 
     // Return the result back
     return factCounts;
 }
 
-/** A helper method to the get2ndMax method
+/** A version of factorize(const BigIntVec&) that writes the results
+ * (one per line) directly to a stream.  Each chunk of numbers is
+ * formatted into its own buffer, so no per-number strings are
+ * created, and the buffers are written in order at the end.
  *
- * \param[in] numList The list of numbers from where the maximum and the
- * second maximum value is to be computed.
+ * \param[in] numVec The list of numbers to be factorized.
  *
- * \param[in] thrMax The maximum value outputed by the method
- * 
- * \param[in] the2ndMax The second maximum value outputed by the method
+ * \param[out] os The output stream to where the results are written.
+ */
+void factorize(const BigIntVec& numVec, std::ostream& os) {
+    ThreadPool& pool = ThreadPool::instance();
+    const size_t grain = std::max<size_t>(1, numVec.size() /
+                                          (pool.size() * 32));
+    std::vector<std::string> chunks((numVec.size() + grain - 1) / grain);
+    pool.parallelFor(numVec.size(), grain, [&](size_t start, size_t end) {
+        // parallelFor hands out ranges that start at a multiple of grain
+        formatRange(numVec.data() + start, numVec.data() + end,
+                    chunks[start / grain]);
+    });
+    for (const auto& chunk : chunks) {
+        os.write(chunk.data(), chunk.size());
+    }
+}
+
+/** Helper method to obtain the line reported for a number wider than
+ * 64 bits (in the same format as threadMain).
  *
- * \param[in] start The starting index of the array
- * 
- * \param[in] end The ending index of the array
- *
-*/
-void threadMain2(const BigIntVec& numList, BigInt& thrMax,
-BigInt& thr2ndMax, const int start, const int end) {
-    BigInt larVal = numList[0], secLarVal = numList[1];
-
-    //--------------------------------------------------------------
-    //  Implement solution to determine 2nd largest value from
-    //  the input stream is
-    //--------------------------------------------------------------
-    if (larVal < secLarVal) {
-        // swap max and secMax to get them in the
-        // right order
-        std::swap(larVal, secLarVal);
+ * \param[in] num The number to be factorized (at least 2^64).
+ *
+ * \return The result line.
+ */
+template <size_t Limbs>
+std::string wideResult(const WideUInt<Limbs>& num) {
+    METRIC_TIMER("hw05_factor_seconds{width=\"wide\"}",
+                 "Time to factor one number.");
+    METRIC_COUNT("hw05_numbers_total{width=\"wide\"}", "Numbers factored.", 1);
+    std::vector<WideUInt<Limbs>> factors;
+    try {
+        factors = primeFactors(num);
+    } catch (const std::runtime_error&) {
+        METRIC_COUNT("hw05_unfactored_total", "Numbers that could not be "
+                     "factored.", 1);
+        return num.toString() + ": Could not be factored.";
+    }
+    if (factors.size() == 1) {
+        return num.toString() + ": Is already prime.";
     }
+    return num.toString() + " = " + factors.front().toString() +
+        " (prime) * " + (num / factors.front()).toString() +
+        (factors.size() == 2 ? " (prime)" : "");
+}
 
-    // repeatedly read values
-    for (int i = start; i < end; i++) {
-        BigInt val = numList[i];
+/** Helper method to obtain the line reported for a number of up to
+ * 512 bits.  The narrowest width that holds the number is used, so
+ * numbers that fit in 64 bits take the usual fast path.
+ *
+ * \param[in] num The number to be factorized.
+ *
+ * \return The result line.
+ */
+std::string wideResult(const WideUInt<8>& num) {
+    const int bits = num.bitLength();
+    if (bits <= 64) {
+        char buf[MaxResultLen];
+        return std::string(buf, formatResult(computeResult(num.low64()), buf));
+    } else if (bits <= 128) {
+        return wideResult(WideUInt<2>(num));
+    } else if (bits <= 256) {
+        return wideResult(WideUInt<4>(num));
+    }
+    return wideResult<8>(num);
+}
 
-        if (val > larVal) {
-            secLarVal = larVal;
-            larVal = val;
-        } else if (val > secLarVal && val < larVal) { 
-            secLarVal = val; 
+/** A version of factorize(const BigIntVec&) for numbers that may not
+ * fit in a BigInt, such as 128-bit IDs.  The numbers are given as
+ * decimal strings of up to 512 bits.  Numbers with two or more prime
+ * factors of more than about 30 digits are reported as "Could not be
+ * factored."
+ *
+ * \param[in] numStrs The decimal numbers to be factorized.  A
+ * std::runtime_error is thrown if any is not a valid number or is
+ * wider than 512 bits.
+ *
+ * \return The responses, in the same format as factorize.
+ */
+StrVec factorize(const StrVec& numStrs) {
+    std::vector<WideUInt<8>> nums;
+    for (const auto& str : numStrs) {
+        nums.push_back(WideUInt<8>::fromString(str));
+    }
+    StrVec results(nums.size());
+    ThreadPool& pool = ThreadPool::instance();
+    pool.parallelFor(nums.size(), 1, [&](size_t start, size_t end) {
+        for (size_t i = start; (i < end); i++) {
+            results[i] = wideResult(nums[i]);
         }
+    });
+    return results;
+}
+
+/** A streaming version of factorize(const BigIntVec&) for inputs that
+ * are too large to hold in memory.  Numbers are read in batches and
+ * each batch is factorized on the shared ThreadPool.  Finished batches
+ * are held in a small reorder buffer and written out (by whichever
+ * thread finishes last) as soon as every earlier batch is done, so the
+ * output is in input order.  At most maxInFlight batches are read
+ * ahead, which bounds the memory used.
+ * The first batches are small (and then double in size) so that the
+ * first results appear quickly.
+ *
+ * \param[in] is The input stream from where the numbers are read.
+ *
+ * \param[out] os The output stream to where the results (one per line,
+ * in the same format as factorize) are written.
+ *
+ * \param[in] batchSize The largest number of values per batch.  A
+ * std::runtime_error is thrown if it is zero.
+ *
+ * \param[in] maxInFlight The largest number of batches being
+ * factorized (or waiting to be written) at any time.  Zero picks
+ * four per worker thread.
+ */
+void factorize(std::istream& is, std::ostream& os,
+               const size_t batchSize = 4096, size_t maxInFlight = 0) {
+    if (batchSize == 0) {
+        throw std::runtime_error("Batch size must be at least 1");
+    }
+    ThreadPool& pool = ThreadPool::instance();
+    if (maxInFlight == 0) {
+        maxInFlight = 4 * pool.size();
     }
+    // Reading from a stream tied to os (like std::cin to std::cout)
+    // flushes os, which would race with the threads writing results.
+    std::ostream* const tiedTo = is.tie(nullptr);
+    std::mutex mutex;
+    std::condition_variable batchDone;
+    std::map<size_t, std::string> finished;  // reorder buffer: batch -> lines
+    size_t submitted = 0, written = 0;
 
-    // Assigning values to thread
-    thrMax = larVal;
-    thr2ndMax = secLarVal;
+    // Write out the batches that are next in order.  Called (and
+    // returns) with the lock held, but releases it while writing.
+    // Only one thread writes at a time: the batch being written has
+    // already been removed, so other callers find nothing to write
+    // until written is incremented.
+    auto writeReady = [&](std::unique_lock<std::mutex>& lock) {
+        for (auto it = finished.find(written); it != finished.end();
+             it = finished.find(written)) {
+            const std::string lines = std::move(it->second);
+            finished.erase(it);
+            lock.unlock();
+            os.write(lines.data(), lines.size());
+            os.flush();
+            lock.lock();
+            written++;
+        }
+    };
+
+    size_t size = std::min<size_t>(16, batchSize);
+    for (BigIntVec batch; is;) {
+        batch.clear();
+        for (BigInt num; batch.size() < size && is >> num;) {
+            batch.push_back(num);
+        }
+        if (batch.empty()) {
+            break;
+        }
+        size = std::min(batchSize, size * 2);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        writeReady(lock);
+        batchDone.wait(lock, [&] {
+            writeReady(lock);
+            return submitted - written < maxInFlight; });
+        const size_t id = submitted++;
+        lock.unlock();
+
+        pool.submit([&, id, nums = std::move(batch)] {
+            std::string lines;
+            formatRange(nums.data(), nums.data() + nums.size(), lines);
+            // Write the results here too, since the reading thread may
+            // be blocked waiting for input (e.g., from a pipe).
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.emplace(id, std::move(lines));
+            writeReady(lock);
+            batchDone.notify_all();
+        });
+    }
+
+    // Drain the remaining batches.
+    std::unique_lock<std::mutex> lock(mutex);
+    batchDone.wait(lock, [&] {
+        writeReady(lock);
+        return written == submitted; });
+    is.tie(tiedTo);
 }
 
 /** A data parallel method to compute the 2nd maximum value in a given
- * list of values using multiple threads.  This method uses
- * "reduction" approach for computing the 2nd-maximum-value using
- * multiple threads.
+ * list of values using multiple threads.  This method uses the
+ * "reduction" approach (see topK in TopK.h): each thread finds the two
+ * largest distinct values in its own range and the per-thread results
+ * are then merged.
  *
  * \param[in] numList The list of numbers from where the maximum value
  * is to be computed.
  *
- * \param[in] thrCount The number of threads to be used. The starter
- * code ignores this parameter.
+ * \param[in] thrCount The number of threads to be used.
  *
- * \return The 2nd maximum value in the given numList.
- * numList.
+ * \return The 2nd maximum (distinct) value in the given numList.  If
+ * all the values are the same, that value is returned.  Zero is
+ * returned for an empty list.
  */
 BigInt get2ndMax(const BigIntVec& numList, const int thrCount) {
-    // The 2nd maximum logic was already done in class (see Exercise
-    // #1). Suitably use the logic here.
-
-    // Tip: Each thread should compute the max and 2nd-max. Then the
-    // main thread should use these values to compute the overall
-    // 2nd-max
-
-    BigIntVec thrMax(thrCount);
-    BigIntVec thr2ndMax(thrCount);
-
-    // Compute the range of values each thread should iterate over.
-    const int size = numList.size();
-    const int count = (numList.size() / thrCount) + 1;
-    // Now spin-up threads to do the work.
-    std::vector<std::thread> thrList(thrCount);
-    for (int start = 0, thr = 0; (thr < thrCount); thr++, start += count) {
-        int end = std::min(size, (start + count));
-
-        thrList[thr] = (std::thread(threadMain2, std::ref(numList),
-        std::ref(thrMax[thr]), std::ref(thr2ndMax[thr]), start, end));
+    const BigIntVec top = topK(numList, 2, thrCount);
+    if (top.empty()) {
+        return 0;
     }
-
-    // Wait for all of the threads to finish.
-    for (auto& t : thrList) {
-        t.join();
-    }
-
-    // Getting two max values from a vector of just max values and a vector of
-    // second max values
-    BigInt firstMax = *std::max_element(thrMax.begin(), thrMax.end());
-    BigInt secondMax = *std::max_element(thr2ndMax.begin(), thr2ndMax.end());
-
-    // returning the minimum value between the two
-    return std::min(firstMax, secondMax);
+    return top.back();
 }
@@ -0,0 +1,141 @@
+// Copyright 2023 Brendan Han
+
+/**
+ * A command-line driver for HW05, also used as the worker process for
+ * FactorFanOut: it factorizes the numbers read on stdin and writes one
+ * result line per number to stdout, in order.  It is meant to be
+ * linked with HW05.cpp.
+ *
+ * Usage: HW05Worker [options] [batchSize]
+ *
+ *   --fanout <n>        Coordinate n worker processes (copies of this
+ *                       program, pinned to NUMA nodes or CPUs) with
+ *                       FactorFanOut instead of factorizing here.  Zero
+ *                       means one per NUMA node.
+ *   --wide              Accept numbers of up to 512 bits (e.g., 128-bit
+ *                       IDs), factorized batchSize at a time.
+ *   --sieve-bound <n>   The bound of the sieve's primality table
+ *                       (default 2^26).
+ *   --spf-bound <n>     The bound of the sieve's smallest-factor table
+ *                       (default 2^22, at most 2^32).
+ *   --sieve-cache <f>   A file in which the sieve's tables are cached
+ *                       (memory-mapped on later runs).
+ */
+
+#include <unistd.h>
+#include <climits>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "FactorFanOut.h"
+#include "PrimeSieve.h"
+
+void factorize(std::istream& is, std::ostream& os, const size_t batchSize,
+               size_t maxInFlight);
+StrVec factorize(const StrVec& numStrs);
+
+namespace {
+
+/**
+ * Helper method to factorize numbers too wide for the streaming
+ * factorize, one batch at a time.
+ *
+ * \param[in] is The input stream from where the numbers are read.
+ *
+ * \param[out] os The output stream to where the results are written.
+ *
+ * \param[in] batchSize The number of values per batch.
+ */
+void factorizeWide(std::istream& is, std::ostream& os,
+                   const size_t batchSize) {
+    StrVec batch;
+    for (std::string num; is >> num || !batch.empty();) {
+        if (is) {
+            batch.push_back(num);
+            if (batch.size() < batchSize) {
+                continue;
+            }
+        }
+        for (const auto& line : factorize(batch)) {
+            os << line << '\n';
+        }
+        os.flush();
+        batch.clear();
+    }
+}
+
+/**
+ * Helper method to obtain the path of this program, to start copies
+ * of it as workers.
+ */
+std::string selfPath() {
+    char path[PATH_MAX];
+    const ssize_t len = readlink("/proc/self/exe", path, sizeof(path));
+    if (len <= 0 || len == sizeof(path)) {
+        throw std::runtime_error("Unable to find the worker program");
+    }
+    return std::string(path, len);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    std::ios_base::sync_with_stdio(false);
+    try {
+        size_t batchSize = 4096;
+        uint64_t sieveBound = 1ULL << 26, spfBound = 1ULL << 22;
+        std::string sieveCache;
+        bool wide = false;
+        int fanOut = -1;  // No fan-out
+        StrVec workerCmd;  // The options passed on to the workers
+        for (int i = 1; (i < argc); i++) {
+            const std::string opt = argv[i];
+            if (opt.compare(0, 2, "--") != 0) {
+                batchSize = std::stoul(opt);
+                continue;
+            } else if (opt == "--wide") {
+                wide = true;
+                workerCmd.push_back(opt);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + opt);
+            }
+            const std::string val = argv[++i];
+            if (opt == "--fanout") {
+                fanOut = std::stoi(val);
+                continue;
+            }
+            workerCmd.insert(workerCmd.end(), {opt, val});
+            if (opt == "--sieve-bound") {
+                sieveBound = std::stoull(val);
+            } else if (opt == "--spf-bound") {
+                spfBound = std::stoull(val);
+            } else if (opt == "--sieve-cache") {
+                sieveCache = val;
+            } else {
+                throw std::runtime_error("Unknown option " + opt);
+            }
+        }
+        // Before the first factorization builds the sieve.
+        PrimeSieve::configure(sieveBound, spfBound, sieveCache);
+        if (batchSize == 0) {
+            throw std::runtime_error("Batch size must be at least 1");
+        } else if (fanOut >= 0) {
+            workerCmd.insert(workerCmd.begin(), selfPath());
+            FactorFanOut(workerCmd, fanOut).run(std::cin, std::cout,
+                                                batchSize);
+        } else if (wide) {
+            factorizeWide(std::cin, std::cout, batchSize);
+        } else {
+            factorize(std::cin, std::cout, batchSize, 0);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
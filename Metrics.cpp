@@ -0,0 +1,404 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the Metrics class, including the Prometheus text
+ * export and the small HTTP server that serves it.
+ *
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "Metrics.h"
+
+/**
+ * Owns the calling thread's data: registers it on the thread's first
+ * update and folds it into the totals when the thread exits.
+ */
+struct MetricsThreadHandle {
+    Metrics::ThreadData* data;
+
+    MetricsThreadHandle() : data(new Metrics::ThreadData()) {
+        Metrics& m = Metrics::instance();
+        std::lock_guard<std::mutex> lock(m.mutex);
+        m.threads.push_back(data);
+    }
+
+    ~MetricsThreadHandle() {
+        Metrics::instance().retire(data);
+    }
+};
+
+namespace {
+
+/** Shortcut for the relaxed memory order used by all the updates. */
+const auto Relaxed = std::memory_order_relaxed;
+
+/**
+ * Helper method to split a metric name into its base name and its
+ * labels, e.g., "a{b=\"c\"}" into "a" and "b=\"c\"".
+ */
+void splitName(const std::string& name, std::string& base,
+               std::string& labels) {
+    const size_t brace = name.find('{');
+    base   = name.substr(0, brace);
+    labels = (brace == std::string::npos) ? "" :
+        name.substr(brace + 1, name.size() - brace - 2);
+}
+
+/**
+ * Helper method to order metrics so that all the label sets of a base
+ * name are adjacent, as the text format requires.
+ *
+ * \param[in] infos The registered metrics.
+ *
+ * \return The indexes of the metrics, sorted by base name.
+ */
+template <typename Info>
+std::vector<size_t> byBaseName(const std::vector<Info>& infos) {
+    std::vector<std::string> bases(infos.size());
+    std::string labels;
+    for (size_t i = 0; (i < infos.size()); i++) {
+        splitName(infos[i].name, bases[i], labels);
+    }
+    std::vector<size_t> order(infos.size());
+    for (size_t i = 0; (i < order.size()); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return bases[a] < bases[b]; });
+    return order;
+}
+
+/**
+ * Helper method to write the HELP and TYPE lines once per base name.
+ */
+void writeHeader(std::ostream& os, const std::string& base,
+                 const std::string& help, const std::string& type,
+                 std::string& lastBase) {
+    if (base != lastBase) {
+        os << "# HELP " << base << ' ' << help << "\n# TYPE " << base << ' '
+           << type << '\n';
+        lastBase = base;
+    }
+}
+
+/**
+ * Writes the metrics file when the program exits and starts the HTTP
+ * server at startup, as configured by METRICS_FILE and METRICS_PORT.
+ */
+struct AutoExport {
+    /** The process that should write the file (not a forked child). */
+    const pid_t pid = getpid();
+
+    AutoExport() {
+        if (const char* port = std::getenv("METRICS_PORT")) {
+            if (!Metrics::instance().serve(std::atoi(port))) {
+                std::cerr << "Unable to serve metrics on port " << port
+                          << std::endl;
+            }
+        }
+    }
+
+    ~AutoExport() {
+        const char* path = std::getenv("METRICS_FILE");
+        if (path != nullptr && getpid() == pid &&
+            !Metrics::instance().writeFile(path)) {
+            std::cerr << "Unable to write metrics to " << path << std::endl;
+        }
+    }
+} autoExport;
+
+}  // namespace
+
+Metrics::ThreadData::~ThreadData() {
+    for (auto& b : buckets) {
+        delete[] b.load();
+    }
+}
+
+// The registry is never destroyed, so that threads (and static
+// objects) that finish during program exit can still use it.
+Metrics& Metrics::instance() {
+    static Metrics* metrics = new Metrics();
+    return *metrics;
+}
+
+Metrics::ThreadData& Metrics::local() {
+    thread_local MetricsThreadHandle handle;
+    return *handle.data;
+}
+
+size_t Metrics::counterId(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; (i < counterInfo.size()); i++) {
+        if (counterInfo[i].name == name) {
+            return i;
+        }
+    }
+    if (counterInfo.size() == MaxCounters) {
+        throw std::runtime_error("Too many counters: " + name);
+    }
+    counterInfo.push_back({name, help});
+    return counterInfo.size() - 1;
+}
+
+size_t Metrics::histogramId(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; (i < histInfo.size()); i++) {
+        if (histInfo[i].name == name) {
+            return i;
+        }
+    }
+    if (histInfo.size() == MaxHistograms) {
+        throw std::runtime_error("Too many histograms: " + name);
+    }
+    histInfo.push_back({name, help});
+    return histInfo.size() - 1;
+}
+
+// Only this thread writes its values, so a plain load and store
+// (instead of a locked fetch_add) is enough.
+void Metrics::add(const size_t id, const uint64_t n) {
+    std::atomic<uint64_t>& c = local().counters[id];
+    c.store(c.load(Relaxed) + n, Relaxed);
+}
+
+void Metrics::record(const size_t id, const uint64_t ns) {
+    ThreadData& td = local();
+    std::atomic<uint64_t>* buckets = td.buckets[id].load(Relaxed);
+    if (buckets == nullptr) {
+        buckets = new std::atomic<uint64_t>[BucketCount]();
+        td.buckets[id].store(buckets, std::memory_order_release);
+    }
+    std::atomic<uint64_t>& b = buckets[bucketOf(ns)];
+    b.store(b.load(Relaxed) + 1, Relaxed);
+    td.sums[id].store(td.sums[id].load(Relaxed) + ns, Relaxed);
+}
+
+size_t Metrics::bucketOf(const uint64_t ns) {
+    if (ns < (1ULL << SubBits)) {
+        return ns;
+    }
+    const int msb = 63 - __builtin_clzll(ns);
+    if (msb >= MaxBits) {
+        return BucketCount - 1;
+    }
+    const int shift = msb - SubBits;
+    const uint64_t sub = (ns >> shift) & ((1ULL << SubBits) - 1);
+    return ((shift + 1) << SubBits) + sub;
+}
+
+uint64_t Metrics::bucketLimit(const size_t bucket) {
+    if (bucket < (1ULL << SubBits)) {
+        return bucket;
+    }
+    const int shift = (bucket >> SubBits) - 1;
+    const uint64_t sub = bucket & ((1ULL << SubBits) - 1);
+    return (((1ULL << SubBits) + sub + 1) << shift) - 1;
+}
+
+void Metrics::retire(ThreadData* data) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; (i < MaxCounters); i++) {
+        retired.counters[i] += data->counters[i].load(Relaxed);
+    }
+    for (size_t h = 0; (h < MaxHistograms); h++) {
+        const std::atomic<uint64_t>* src = data->buckets[h].load();
+        if (src == nullptr) {
+            continue;
+        }
+        if (retired.buckets[h].load() == nullptr) {
+            retired.buckets[h] = new std::atomic<uint64_t>[BucketCount]();
+        }
+        std::atomic<uint64_t>* dest = retired.buckets[h].load();
+        for (size_t b = 0; (b < BucketCount); b++) {
+            dest[b] += src[b].load(Relaxed);
+        }
+        retired.sums[h] += data->sums[h].load(Relaxed);
+    }
+    threads.erase(std::find(threads.begin(), threads.end(), data));
+    delete data;
+}
+
+uint64_t Metrics::count(const size_t id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t total = retired.counters[id].load(Relaxed);
+    for (const ThreadData* td : threads) {
+        total += td->counters[id].load(Relaxed);
+    }
+    return total;
+}
+
+std::vector<uint64_t> Metrics::histogram(const size_t id,
+                                         uint64_t& sum) const {
+    std::vector<uint64_t> total(BucketCount);
+    sum = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<const ThreadData*> all(threads.begin(), threads.end());
+    all.push_back(&retired);
+    for (const ThreadData* td : all) {
+        const std::atomic<uint64_t>* buckets =
+            td->buckets[id].load(std::memory_order_acquire);
+        if (buckets == nullptr) {
+            continue;
+        }
+        for (size_t b = 0; (b < BucketCount); b++) {
+            total[b] += buckets[b].load(Relaxed);
+        }
+        sum += td->sums[id].load(Relaxed);
+    }
+    return total;
+}
+
+uint64_t Metrics::quantile(const size_t id, const double q) const {
+    uint64_t sum;
+    const std::vector<uint64_t> buckets = histogram(id, sum);
+    uint64_t total = 0;
+    for (const uint64_t b : buckets) {
+        total += b;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, std::ceil(q * total));
+    uint64_t seen = 0;
+    for (size_t b = 0; (b < BucketCount) && (total > 0); b++) {
+        if ((seen += buckets[b]) >= rank) {
+            return bucketLimit(b);
+        }
+    }
+    return 0;
+}
+
+// Histograms are exported with one "le" bound per power of two from
+// about 1 microsecond, which lines up with the internal buckets (each
+// power of two starts a new group of sub-buckets).
+void Metrics::writePrometheus(std::ostream& os) const {
+    std::vector<Info> counters, hists;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters = counterInfo;
+        hists    = histInfo;
+    }
+    std::string base, labels, lastBase;
+    for (const size_t i : byBaseName(counters)) {
+        splitName(counters[i].name, base, labels);
+        writeHeader(os, base, counters[i].help, "counter", lastBase);
+        os << counters[i].name << ' ' << count(i) << '\n';
+    }
+    for (const size_t i : byBaseName(hists)) {
+        splitName(hists[i].name, base, labels);
+        writeHeader(os, base, hists[i].help, "histogram", lastBase);
+        const std::string sep = labels.empty() ? "" : labels + ",";
+        uint64_t sum;
+        const std::vector<uint64_t> buckets = histogram(i, sum);
+        uint64_t cumulative = 0;
+        size_t b = 0;
+        for (int bits = 10; (bits <= MaxBits); bits++) {
+            const size_t end = (bits - SubBits + 1) << SubBits;
+            for (; (b < end) && (b < BucketCount); b++) {
+                cumulative += buckets[b];
+            }
+            char le[32];
+            std::snprintf(le, sizeof(le), "%g", (1ULL << bits) / 1e9);
+            os << base << "_bucket{" << sep << "le=\"" << le << "\"} "
+               << cumulative << '\n';
+        }
+        for (; (b < BucketCount); b++) {
+            cumulative += buckets[b];
+        }
+        const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+        os << base << "_bucket{" << sep << "le=\"+Inf\"} " << cumulative
+           << '\n' << base << "_sum" << braces << ' ' << std::setprecision(9)
+           << sum / 1e9 << '\n' << base << "_count" << braces << ' '
+           << cumulative << '\n';
+    }
+}
+
+bool Metrics::writeFile(const std::string& path) const {
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream os(tmpPath);
+        writePrometheus(os);
+        if (!os.good()) {
+            return false;
+        }
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// Each connection gets the full metrics text regardless of the
+// request path, which is all a Prometheus scraper needs.
+bool Metrics::serve(const unsigned short port) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return false;
+    }
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr = {};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        listen(fd, 16) == -1) {
+        close(fd);
+        return false;
+    }
+    std::thread([this, fd] {
+        // Persistent accept errors (e.g., EMFILE) back off up to a
+        // second instead of spinning.
+        std::chrono::milliseconds backoff(0);
+        for (;;) {
+            const int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client == -1) {
+                if (errno != EINTR && errno != ECONNABORTED) {
+                    backoff = std::min(std::max(backoff * 2,
+                                                std::chrono::milliseconds(10)),
+                                       std::chrono::milliseconds(1000));
+                    std::this_thread::sleep_for(backoff);
+                }
+                continue;
+            }
+            backoff = std::chrono::milliseconds(0);
+            // A client that connects but never sends (or reads) must
+            // not hold up this, the only serving thread, for long.
+            const timeval timeout = {1, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                       sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                       sizeof(timeout));
+            char request[4096];
+            (void)read(client, request, sizeof(request));
+            std::ostringstream body;
+            writePrometheus(body);
+            const std::string text = body.str();
+            const std::string reply = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " + std::to_string(text.size()) +
+                "\r\nConnection: close\r\n\r\n" + text;
+            for (size_t sent = 0; (sent < reply.size());) {
+                const ssize_t n = send(client, reply.data() + sent,
+                                       reply.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    break;
+                }
+                sent += n;
+            }
+            close(client);
+        }
+    }).detach();
+    return true;
+}
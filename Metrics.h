@@ -0,0 +1,215 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/**
+ * This source file contains the definition for a small metrics
+ * library shared by all the homework programs: counters, latency
+ * histograms, and scoped timers, exported in the Prometheus text
+ * format.
+ *
+ * Instrumentation is compiled in only when ENABLE_METRICS is defined
+ * (e.g., g++ -DENABLE_METRICS ... Metrics.cpp).  Otherwise the
+ * METRIC_* macros below expand to nothing (their arguments are not
+ * even evaluated) and Metrics.cpp need not be linked.
+ *
+ * When enabled, the metrics are exported according to two environment
+ * variables:
+ *
+ *   METRICS_FILE  Written (atomically) when the program exits.
+ *   METRICS_PORT  Served on http://127.0.0.1:<port>/metrics while the
+ *                 program runs.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * The registry of all metrics.  Updates go to per-thread storage
+ * (each value has a single writer, so no locked instructions or shared
+ * cache lines are involved); export sums the values of all threads.
+ * Metric names may include Prometheus labels, e.g.,
+ * "hw03_hacks_total{reason=\"banned_ip\"}".
+ */
+class Metrics {
+public:
+    /** The most counters and histograms that can be registered. */
+    static const size_t MaxCounters = 256, MaxHistograms = 32;
+
+    /** Histograms have 8 linear sub-buckets per power of two (like
+        HdrHistogram with 1 significant digit), i.e., at most 12.5%
+        error, for values (in nanoseconds) below 2^MaxBits (about 18
+        minutes).  Larger values go in the last bucket. */
+    static const int SubBits = 3, MaxBits = 40;
+    static const size_t BucketCount = (MaxBits - SubBits + 1) << SubBits;
+
+    /** Obtain the process-wide registry. */
+    static Metrics& instance();
+
+    /** Register (or find) a counter.
+
+        \param[in] name The metric name, optionally with labels.
+
+        \param[in] help The description exported with the metric.
+
+        \return The id used with add.
+    */
+    size_t counterId(const std::string& name, const std::string& help);
+
+    /** Register (or find) a latency histogram, exported in seconds.
+
+        \param[in] name The metric name, optionally with labels.
+
+        \param[in] help The description exported with the metric.
+
+        \return The id used with record.
+    */
+    size_t histogramId(const std::string& name, const std::string& help);
+
+    /** Add to a counter (for the calling thread). */
+    static void add(const size_t id, const uint64_t n);
+
+    /** Add a latency, in nanoseconds, to a histogram. */
+    static void record(const size_t id, const uint64_t ns);
+
+    /** Obtain the total of a counter over all threads. */
+    uint64_t count(const size_t id) const;
+
+    /** Estimate a quantile of a histogram.
+
+        \param[in] id The histogram.
+
+        \param[in] q The quantile, e.g., 0.99.
+
+        \return The estimated value in nanoseconds (0 if empty).
+    */
+    uint64_t quantile(const size_t id, const double q) const;
+
+    /** Write all metrics in the Prometheus text format.
+
+        \param[out] os The stream to write to.
+    */
+    void writePrometheus(std::ostream& os) const;
+
+    /** Write all metrics to a file (via a temporary file and rename).
+
+        \param[in] path The file to be written.
+
+        \return True if the file was written.
+    */
+    bool writeFile(const std::string& path) const;
+
+    /** Start a background thread that serves the metrics over HTTP on
+        the loopback interface.
+
+        \param[in] port The TCP port.
+
+        \return True if the port could be opened.
+    */
+    bool serve(const unsigned short port);
+
+    /** Map a latency to its histogram bucket. */
+    static size_t bucketOf(const uint64_t ns);
+
+    /** Obtain the largest latency that falls in a bucket. */
+    static uint64_t bucketLimit(const size_t bucket);
+
+    /** The per-thread values.  Each is written only by its thread. */
+    struct ThreadData {
+        std::atomic<uint64_t> counters[MaxCounters] = {};
+        /** Allocated on the thread's first record to the histogram. */
+        std::atomic<std::atomic<uint64_t>*> buckets[MaxHistograms] = {};
+        std::atomic<uint64_t> sums[MaxHistograms] = {};
+        ~ThreadData();
+    };
+
+private:
+    Metrics() = default;
+
+    /** Obtain (registering on first use) the calling thread's data. */
+    static ThreadData& local();
+
+    /** Fold the values of a finishing thread into retired. */
+    void retire(ThreadData* data);
+
+    /** Sum the buckets of a histogram over all threads. */
+    std::vector<uint64_t> histogram(const size_t id, uint64_t& sum) const;
+
+    friend struct MetricsThreadHandle;
+
+    /** The name and help text of a registered metric. */
+    struct Info {
+        std::string name, help;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Info> counterInfo, histInfo;
+    std::vector<ThreadData*> threads;
+    /** The values of threads that have exited. */
+    ThreadData retired;
+};
+
+/**
+ * Records the time from construction to destruction (i.e., of a
+ * scope) in a histogram.
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const size_t id) : id(id),
+        start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        Metrics::record(id, std::chrono::duration_cast<
+                        std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    const size_t id;
+    const std::chrono::steady_clock::time_point start;
+};
+
+#ifdef ENABLE_METRICS
+#define METRICS_CONCAT2(a, b) a##b
+#define METRICS_CONCAT(a, b) METRICS_CONCAT2(a, b)
+
+/** Add n to the counter with the given name (registered once). */
+#define METRIC_COUNT(name, help, n) do {                               \
+        static const size_t metricId =                                 \
+            Metrics::instance().counterId(name, help);                 \
+        Metrics::add(metricId, n);                                     \
+    } while (0)
+
+/** Time the rest of the enclosing scope into the given histogram. */
+#define METRIC_TIMER(name, help)                                       \
+    static const size_t METRICS_CONCAT(metricTimerId, __LINE__) =      \
+        Metrics::instance().histogramId(name, help);                   \
+    const ScopedTimer METRICS_CONCAT(metricTimer, __LINE__)(           \
+        METRICS_CONCAT(metricTimerId, __LINE__))
+
+/** Add a latency measured elsewhere (in nanoseconds) to a histogram. */
+#define METRIC_RECORD(name, help, ns) do {                             \
+        static const size_t metricId =                                 \
+            Metrics::instance().histogramId(name, help);               \
+        Metrics::record(metricId, ns);                                 \
+    } while (0)
+#else
+#define METRIC_COUNT(name, help, n) do {} while (0)
+#define METRIC_TIMER(name, help) do {} while (0)
+#define METRIC_RECORD(name, help, ns) do {} while (0)
+#endif
+
+#endif
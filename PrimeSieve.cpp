@@ -0,0 +1,255 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the PrimeSieve class.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "PrimeSieve.h"
+
+namespace {
+
+/** The 8 residues modulo 30 that are coprime to 30 (one bit each). */
+const uint8_t Residues[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+
+/** Maps n % 30 to its bit in a wheel byte, or -1 if not coprime. */
+const int8_t BitIndex[30] = {-1, 0, -1, -1, -1, -1, -1, 1, -1, -1,
+                             -1, 2, -1, 3, -1, -1, -1, 4, -1, 5,
+                             -1, -1, -1, 6, -1, -1, -1, -1, -1, 7};
+
+/** Bytes sieved per segment (32 KB, to stay within L1/L2 cache). */
+const uint64_t SegmentBytes = 32 * 1024;
+
+/** The header at the start of a cache file. */
+struct CacheHeader {
+    char magic[8];
+    uint64_t limit, spfBound, bitBytes, spfCount;
+};
+
+/** The magic string identifying (version 1 of) the cache file. */
+const char CacheMagic[8] = {'H', 'W', '5', 'S', 'I', 'E', 'V', '1'};
+
+/** Settings used by instance(); changed via configure(). */
+uint64_t defaultLimit = 1ULL << 26, defaultSpfBound = 1ULL << 22;
+std::string defaultCachePath;
+
+}  // namespace
+
+PrimeSieve::PrimeSieve(const uint64_t limit, const uint64_t spfBound,
+                       const std::string& cachePath) :
+    primeLimit(std::max<uint64_t>(limit, 30)),
+    spfLimit(std::min<uint64_t>(std::max<uint64_t>(spfBound, 2), 1ULL << 32)) {
+    if (!cachePath.empty() && loadCache(cachePath)) {
+        return;
+    }
+    sieveBits();
+    sieveSpf();
+    bits = bitStore.data();
+    spf  = spfStore.data();
+    if (!cachePath.empty()) {
+        saveCache(cachePath);
+    }
+}
+
+PrimeSieve::~PrimeSieve() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+void PrimeSieve::configure(const uint64_t limit, const uint64_t spfBound,
+                           const std::string& cachePath) {
+    defaultLimit     = limit;
+    defaultSpfBound  = spfBound;
+    defaultCachePath = cachePath;
+}
+
+const PrimeSieve& PrimeSieve::instance() {
+    static const PrimeSieve sieve(defaultLimit, defaultSpfBound,
+                                  defaultCachePath);
+    return sieve;
+}
+
+bool PrimeSieve::isPrime(const uint64_t n) const {
+    if (n < 7) {
+        return n == 2 || n == 3 || n == 5;
+    }
+    const int bit = BitIndex[n % 30];
+    return bit >= 0 && ((bits[n / 30] >> bit) & 1);
+}
+
+uint64_t PrimeSieve::smallestFactor(const uint64_t n) const {
+    if (n % 2 == 0) {
+        return 2;
+    }
+    const uint16_t p = spf[n / 2];
+    return (p == 0) ? n : p;
+}
+
+size_t PrimeSieve::factor(uint64_t n, uint64_t* factors) const {
+    size_t count = 0;
+    while (n > 1) {
+        const uint64_t p = smallestFactor(n);
+        factors[count++] = p;
+        n /= p;
+    }
+    return count;
+}
+
+void PrimeSieve::factor(uint64_t n, std::vector<uint64_t>& factors) const {
+    uint64_t found[64];
+    factors.insert(factors.end(), found, found + factor(n, found));
+}
+
+std::vector<uint32_t> PrimeSieve::primes(const uint64_t bound) const {
+    std::vector<uint32_t> list;
+    const uint64_t end = std::min(bound, primeLimit);
+    for (const uint32_t p : {2U, 3U, 5U}) {
+        if (p < end) {
+            list.push_back(p);
+        }
+    }
+    for (uint64_t byte = 0; (byte * 30 < end); byte++) {
+        for (uint8_t bits8 = this->bits[byte]; bits8 != 0;
+             bits8 &= bits8 - 1) {
+            const uint64_t n = byte * 30 + Residues[__builtin_ctz(bits8)];
+            if (n < end) {
+                list.push_back(static_cast<uint32_t>(n));
+            }
+        }
+    }
+    return list;
+}
+
+// Base primes up to sqrt(limit) come from a plain sieve.  The wheel
+// bytes are then sieved one cache-sized segment at a time, carrying
+// each base prime's next odd multiple over from segment to segment.
+void PrimeSieve::sieveBits() {
+    const uint64_t byteCount = (primeLimit + 29) / 30;
+    bitStore.assign(byteCount, 0xFF);
+    bitStore[0] &= ~1;  // 1 is not a prime
+
+    const uint64_t root = std::sqrt(static_cast<double>(primeLimit)) + 1;
+    std::vector<bool> composite(root + 1, false);
+    std::vector<uint64_t> basePrimes, next;
+    for (uint64_t p = 7; (p <= root); p += 2) {
+        if (composite[p]) {
+            continue;
+        }
+        for (uint64_t m = p * p; (m <= root); m += 2 * p) {
+            composite[m] = true;
+        }
+        // Multiples of 3 and 5 are not marked above, so skip them here
+        if (p % 3 != 0 && p % 5 != 0) {
+            basePrimes.push_back(p);
+            next.push_back(p * p);
+        }
+    }
+
+    for (uint64_t segStart = 0; (segStart < byteCount);
+         segStart += SegmentBytes) {
+        const uint64_t hi = std::min(byteCount, segStart + SegmentBytes) * 30;
+        for (size_t i = 0; (i < basePrimes.size()); i++) {
+            const uint64_t step = 2 * basePrimes[i];
+            uint64_t m = next[i];
+            for (; m < hi; m += step) {
+                const int bit = BitIndex[m % 30];
+                if (bit >= 0) {
+                    bitStore[m / 30] &= ~(1U << bit);
+                }
+            }
+            next[i] = m;
+        }
+    }
+
+    // Clear the bits for numbers at or beyond the limit.
+    for (int bit = 0; (bit < 8); bit++) {
+        if ((byteCount - 1) * 30 + Residues[bit] >= primeLimit) {
+            bitStore[byteCount - 1] &= ~(1U << bit);
+        }
+    }
+}
+
+// Only odd numbers are stored (n at index n / 2).  Scanning primes in
+// ascending order means the first prime to mark an entry is smallest.
+void PrimeSieve::sieveSpf() {
+    spfStore.assign((spfLimit + 1) / 2, 0);
+    for (uint64_t p = 3; (p * p < spfLimit); p += 2) {
+        if (spfStore[p / 2] != 0) {
+            continue;  // p is composite
+        }
+        for (uint64_t m = p * p; (m < spfLimit); m += 2 * p) {
+            if (spfStore[m / 2] == 0) {
+                spfStore[m / 2] = static_cast<uint16_t>(p);
+            }
+        }
+    }
+}
+
+bool PrimeSieve::loadCache(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    CacheHeader hdr;
+    const uint64_t bitBytes = (primeLimit + 29) / 30;
+    const uint64_t spfCount = (spfLimit + 1) / 2;
+    const uint64_t spfOffset = (sizeof(hdr) + bitBytes + 1) & ~1ULL;
+    const size_t expected = spfOffset + spfCount * sizeof(uint16_t);
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) != expected ||
+        read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        std::memcmp(hdr.magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+        hdr.limit != primeLimit || hdr.spfBound != spfLimit ||
+        hdr.bitBytes != bitBytes || hdr.spfCount != spfCount) {
+        close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    mapping     = addr;
+    mappingSize = expected;
+    bits = static_cast<const uint8_t*>(addr) + sizeof(hdr);
+    spf  = reinterpret_cast<const uint16_t*>(
+        static_cast<const uint8_t*>(addr) + spfOffset);
+    return true;
+}
+
+// The file is written under a temporary name and renamed into place so
+// a concurrent reader never maps a half-written cache.
+void PrimeSieve::saveCache(const std::string& path) const {
+    CacheHeader hdr;
+    std::memcpy(hdr.magic, CacheMagic, sizeof(CacheMagic));
+    hdr.limit    = primeLimit;
+    hdr.spfBound = spfLimit;
+    hdr.bitBytes = bitStore.size();
+    hdr.spfCount = spfStore.size();
+
+    const std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+    std::ofstream os(tmpPath, std::ios::binary);
+    os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    os.write(reinterpret_cast<const char*>(bitStore.data()), bitStore.size());
+    if ((sizeof(hdr) + bitStore.size()) % 2 != 0) {
+        os.put(0);
+    }
+    os.write(reinterpret_cast<const char*>(spfStore.data()),
+             spfStore.size() * sizeof(uint16_t));
+    os.close();
+    if (!os || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());  // Caching is best-effort
+    }
+}
@@ -0,0 +1,165 @@
+#ifndef PRIME_SIEVE_H
+#define PRIME_SIEVE_H
+
+/**
+ * This source file contains the definition for the PrimeSieve class.
+ * This class precomputes (once) which numbers below a bound are prime
+ * and the smallest prime factor of numbers below a second bound, so
+ * that small and medium numbers can be factored by table lookups.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A segmented sieve of Eratosthenes with two tables:
+ *
+ *   1. A bit-packed primality table using a mod-30 wheel: each byte
+ *      holds the 8 numbers in a block of 30 that are coprime to 30, so
+ *      multiples of 2, 3, and 5 take no space (about 3.75 bytes per
+ *      100 numbers).
+ *
+ *   2. A smallest-prime-factor table for odd numbers.  Entries are 16
+ *      bits since the smallest factor of a composite below 2^32 is
+ *      below 2^16.  Primes are stored as 0.
+ *
+ * The tables may be cached in a file, which is memory-mapped on later
+ * runs instead of sieving again.
+ */
+class PrimeSieve {
+public:
+    /** The constructor builds (or loads) the tables.
+
+        \param[in] limit The primality table covers [0, limit).
+
+        \param[in] spfBound The smallest-prime-factor table covers
+        [0, spfBound).  Must be at most 2^32.
+
+        \param[in] cachePath An optional file in which the tables are
+        cached.  If the file holds tables for the same bounds it is
+        memory-mapped; otherwise the tables are sieved and saved to it.
+        Empty string disables caching.
+    */
+    PrimeSieve(const uint64_t limit, const uint64_t spfBound,
+               const std::string& cachePath = "");
+
+    /** The destructor releases the memory-mapped cache, if any. */
+    ~PrimeSieve();
+
+    PrimeSieve(const PrimeSieve&) = delete;
+    PrimeSieve& operator=(const PrimeSieve&) = delete;
+
+    /** Set the bounds and cache file used by instance.  This method
+        must be called before the first call to instance to have any
+        effect.
+
+        \param[in] limit See constructor.
+
+        \param[in] spfBound See constructor.
+
+        \param[in] cachePath See constructor.
+    */
+    static void configure(const uint64_t limit, const uint64_t spfBound,
+                          const std::string& cachePath = "");
+
+    /** Obtain the process-wide sieve, built on first use.  The
+        default bounds are 2^26 (primality) and 2^22 (smallest factor).
+
+        \return The shared sieve.
+    */
+    static const PrimeSieve& instance();
+
+    /** Obtain the bound of the primality table. */
+    uint64_t limit() const { return primeLimit; }
+
+    /** Obtain the bound of the smallest-prime-factor table. */
+    uint64_t spfBound() const { return spfLimit; }
+
+    /** Determine if a number is prime by table lookup.
+
+        \param[in] n The number to be checked.  Must be below limit().
+
+        \return True if n is prime.
+    */
+    bool isPrime(const uint64_t n) const;
+
+    /** Obtain the smallest prime factor of a number by table lookup.
+
+        \param[in] n The number (at least 2) whose smallest prime
+        factor is needed.  Must be below spfBound().
+
+        \return The smallest prime factor of n (n itself if prime).
+    */
+    uint64_t smallestFactor(const uint64_t n) const;
+
+    /** Store the prime factors of a number, smallest first, using
+        only table lookups.
+
+        \param[in] n The number to be factored.  Must be below
+        spfBound().
+
+        \param[out] factors The array to which the factors are written.
+        It must have room for 64 entries.
+
+        \return The number of factors written.
+    */
+    size_t factor(uint64_t n, uint64_t* factors) const;
+
+    /** Append the prime factors of a number to a list, smallest first,
+        using only table lookups.
+
+        \param[in] n The number to be factored.  Must be below
+        spfBound().
+
+        \param[out] factors The list to which the factors are added.
+    */
+    void factor(uint64_t n, std::vector<uint64_t>& factors) const;
+
+    /** Obtain the primes below a given bound, e.g., for trial division.
+
+        \param[in] bound The upper bound (at most limit()).
+
+        \return The primes below bound in ascending order.
+    */
+    std::vector<uint32_t> primes(const uint64_t bound) const;
+
+private:
+    /** Helper method to run the segmented sieve into bitStore. */
+    void sieveBits();
+
+    /** Helper method to fill in spfStore. */
+    void sieveSpf();
+
+    /** Helper method to memory-map the tables from the cache file.
+
+        \return True if the file exists and matches the bounds.
+    */
+    bool loadCache(const std::string& path);
+
+    /** Helper method to write the tables to the cache file. */
+    void saveCache(const std::string& path) const;
+
+    /** The bound of the primality table. */
+    uint64_t primeLimit;
+    /** The bound of the smallest-prime-factor table. */
+    uint64_t spfLimit;
+    /** The wheel-30 bytes (points into bitStore or the mapping). */
+    const uint8_t* bits = nullptr;
+    /** The odd-only factor table (into spfStore or the mapping). */
+    const uint16_t* spf = nullptr;
+    /** The tables when they were sieved by this process. */
+    std::vector<uint8_t> bitStore;
+    std::vector<uint16_t> spfStore;
+    /** The memory-mapped cache file, if any. */
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+};
+
+#endif
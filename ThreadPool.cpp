@@ -0,0 +1,178 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the ThreadPool class.
+ *
+ */
+
+#include <sched.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include "ThreadPool.h"
+
+namespace {
+/** The pool (if any) that owns the calling thread. */
+thread_local ThreadPool* currentPool = nullptr;
+/** The index of the calling worker's own queue in currentPool. */
+thread_local size_t currentIndex = 0;
+}  // namespace
+
+ThreadPool::ThreadPool(unsigned int thrCount) {
+    if (thrCount == 0) {
+        // Respect the CPUs this process is pinned to (e.g., a worker
+        // started by FactorFanOut), not just the machine's total.
+        cpu_set_t cpus;
+        thrCount = (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) ?
+            CPU_COUNT(&cpus) : std::thread::hardware_concurrency();
+        thrCount = std::max(1U, thrCount);
+    }
+    for (unsigned int i = 0; (i < thrCount); i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (unsigned int i = 0; (i < thrCount); i++) {
+        workers.emplace_back(&ThreadPool::workerMain, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        stopping = true;
+    }
+    idleCond.notify_all();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+// Tasks from a worker stay on its own deque (good locality); others
+// are spread round-robin.  The idle mutex is taken before notifying so
+// a worker that just found nothing to do cannot miss the wakeup.
+void ThreadPool::submit(Task task) {
+    const size_t idx = (currentPool == this) ? currentIndex :
+        nextQueue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[idx]->mutex);
+        queues[idx]->tasks.push_back(std::move(task));
+    }
+    queued++;
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+    }
+    idleCond.notify_one();
+}
+
+// Own deque is used LIFO, victims are robbed FIFO (oldest, typically
+// the largest remaining piece of work).
+bool ThreadPool::tryPop(const size_t self, Task& task) {
+    if (queued == 0) {
+        return false;
+    }
+    const size_t count = queues.size();
+    for (size_t i = 0; (i < count); i++) {
+        WorkQueue& q = *queues[(self + i) % count];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            if (i == 0) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerMain(const size_t self) {
+    currentPool  = this;
+    currentIndex = self;
+    for (Task task;;) {
+        if (tryPop(self, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idleCond.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+// A simple latch tracks the outstanding chunks.  It is decremented
+// under its mutex so that it is safe to destroy once the caller has
+// observed zero while holding that mutex.  A chunk that throws still
+// counts down (the queued chunks refer to this stack frame); the first
+// exception is kept, the chunks not yet started are skipped, and the
+// exception is rethrown once all of them are done.
+void ThreadPool::parallelFor(size_t count, size_t grain,
+                             const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = std::max<size_t>(1, count / (size() * 8));
+    }
+    std::mutex doneMutex;
+    std::condition_variable doneCond;
+    size_t remaining = (count + grain - 1) / grain;
+    std::exception_ptr error;
+    std::atomic<bool> failed(false);
+
+    for (size_t start = 0; (start < count); start += grain) {
+        const size_t end = std::min(count, start + grain);
+        submit([&, start, end] {
+            std::exception_ptr caught;
+            if (!failed) {
+                try {
+                    body(start, end);
+                } catch (...) {
+                    caught = std::current_exception();
+                    failed = true;
+                }
+            }
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (caught && !error) {
+                error = caught;
+            }
+            if (--remaining == 0) {
+                doneCond.notify_all();
+            }
+        });
+    }
+
+    // Help out (instead of just blocking) until every chunk is done.
+    const size_t self = (currentPool == this) ? currentIndex : 0;
+    std::unique_lock<std::mutex> lock(doneMutex);
+    while (remaining > 0) {
+        lock.unlock();
+        Task task;
+        if (tryPop(self, task)) {
+            task();
+            lock.lock();
+        } else {
+            lock.lock();
+            doneCond.wait_for(lock, std::chrono::milliseconds(1),
+                              [&] { return remaining == 0; });
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
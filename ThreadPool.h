@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/**
+ * This source file contains the definition for the ThreadPool class.
+ * This class provides a fixed number of persistent worker threads
+ * that share work by stealing from each other's task queues.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * A fixed-size pool of worker threads.  Each worker has its own deque
+ * of tasks: a worker takes tasks from the back of its own deque and,
+ * when that runs dry, steals from the front of the other workers'
+ * deques.  This keeps all the workers busy even when the cost of
+ * individual tasks varies wildly (e.g., factoring a few hard numbers
+ * among many easy ones).
+ */
+class ThreadPool {
+public:
+    /** A task to be run by the pool. */
+    using Task = std::function<void()>;
+
+    /** The constructor starts the worker threads.
+
+        \param[in] thrCount The number of worker threads.  Zero means
+        one thread per CPU that this process may run on.
+    */
+    explicit ThreadPool(unsigned int thrCount = 0);
+
+    /** The destructor waits for queued tasks to finish and then joins
+        all of the worker threads.
+    */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /** Obtain a process-wide pool sized to the hardware.  The pool is
+        created on first use and lives until the program exits, so
+        repeated calls do not pay for creating threads.
+
+        \return The shared thread pool.
+    */
+    static ThreadPool& instance();
+
+    /** Obtain the number of worker threads in this pool.
+
+        \return The number of worker threads.
+    */
+    size_t size() const;
+
+    /** Queue a task to be run by one of the workers.  When called from
+        a worker of this pool the task goes onto that worker's own
+        deque; otherwise deques are chosen round-robin.
+
+        \param[in] task The task to be run.
+    */
+    void submit(Task task);
+
+    /** A data parallel helper that splits [0, count) into chunks of
+        (at most) grain items, runs body(start, end) for each chunk on
+        the pool, and waits for all of the chunks to finish.  The
+        calling thread helps run queued tasks while it waits, so this
+        method may also be called from within a task.  If body throws,
+        the chunks not yet started are skipped and the first exception
+        is rethrown once the running chunks have finished.
+
+        \param[in] count The number of items to be processed.
+
+        \param[in] grain The maximum number of items per task.  Zero
+        picks a grain that yields several tasks per worker.
+
+        \param[in] body The method to be called for each chunk.
+    */
+    void parallelFor(size_t count, size_t grain,
+                     const std::function<void(size_t, size_t)>& body);
+
+private:
+    /** The deque of tasks owned by one worker. */
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    /** The method run by each worker thread.
+
+        \param[in] self The index of the worker's own queue.
+    */
+    void workerMain(const size_t self);
+
+    /** Helper method to pop a task, first from the back of queue self
+        and then from the front of the other queues.
+
+        \param[in] self The index of the queue to try first.
+
+        \param[out] task The task that was obtained.
+
+        \return True if a task was obtained.
+    */
+    bool tryPop(const size_t self, Task& task);
+
+    /** One work queue per worker thread. */
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    /** The worker threads. */
+    std::vector<std::thread> workers;
+    /** The number of tasks queued but not yet taken by a worker. */
+    std::atomic<size_t> queued{0};
+    /** Round-robin counter for tasks submitted from outside the pool. */
+    std::atomic<size_t> nextQueue{0};
+    /** Set by the destructor to ask workers to exit. */
+    bool stopping = false;
+    /** Mutex and condition variable used to park idle workers. */
+    std::mutex idleMutex;
+    std::condition_variable idleCond;
+};
+
+#endif
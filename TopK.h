@@ -0,0 +1,160 @@
+#ifndef TOP_K_H
+#define TOP_K_H
+
+/**
+ * This source file contains a generic, multithreaded "top-k"
+ * reduction: finding the k largest (or smallest) distinct values in a
+ * list.  Each thread reduces a contiguous chunk into its own
+ * cache-line-aligned partial result and the partials are then merged.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * The k best distinct values seen so far, kept sorted best-first.
+ * Instances are aligned to a cache line so that the partial results of
+ * different threads never share a line (no false sharing).
+ *
+ * \tparam T The type of values.
+ *
+ * \tparam Compare comp(a, b) is true if a ranks below b; std::less
+ * gives the largest values and std::greater the smallest.
+ */
+template <typename T, typename Compare>
+struct alignas(64) TopKPartial {
+    /** The best values (at most k), best first. */
+    std::vector<T> best;
+
+    /** Add a value, ignoring it if it is not among the k best or is
+        equal to a value already kept.
+
+        \param[in] val The value to be added.
+
+        \param[in] k The number of values to keep.
+
+        \param[in] comp The comparator.
+    */
+    void add(const T& val, const size_t k, const Compare& comp) {
+        if (best.size() == k && !comp(best.back(), val)) {
+            return;  // Not better than the k-th best
+        }
+        // First position whose value ranks at or below val.
+        auto pos = std::find_if(best.begin(), best.end(),
+                                [&](const T& b) { return !comp(val, b); });
+        if (pos != best.end() && !comp(*pos, val)) {
+            return;  // Duplicate of a kept value
+        }
+        best.insert(pos, val);
+        if (best.size() > k) {
+            best.pop_back();
+        }
+    }
+};
+
+/**
+ * Helper method to reduce one contiguous chunk.  The chunk is scanned
+ * in blocks: a block's best value is found with a branch-free loop
+ * that the compiler vectorizes (SIMD), and only blocks that beat the
+ * current k-th best are rescanned element by element.  Once k values
+ * are known almost every block is skipped this way.
+ *
+ * \param[in] first The start of the chunk.
+ *
+ * \param[in] last One past the end of the chunk.
+ *
+ * \param[in] k The number of values to keep.
+ *
+ * \param[in] comp The comparator.
+ *
+ * \param[out] part The partial result to be filled in.
+ */
+template <typename T, typename Compare>
+void topKChunk(const T* first, const T* last, const size_t k,
+               const Compare& comp, TopKPartial<T, Compare>& part) {
+    const size_t BlockSize = 256;
+    TopKPartial<T, Compare> local;  // Stays in this thread's cache
+    while (first < last) {
+        const T* end = first + std::min<size_t>(BlockSize, last - first);
+        T blockBest = *first;
+        for (const T* p = first + 1; p < end; p++) {
+            blockBest = comp(blockBest, *p) ? *p : blockBest;
+        }
+        if (local.best.size() < k || comp(local.best.back(), blockBest)) {
+            for (const T* p = first; p < end; p++) {
+                local.add(*p, k, comp);
+            }
+        }
+        first = end;
+    }
+    part.best = std::move(local.best);
+}
+
+/**
+ * A data parallel method to compute the k best distinct values in a
+ * list using multiple threads.
+ *
+ * \param[in] list The values to be reduced.
+ *
+ * \param[in] k The number of values wanted.
+ *
+ * \param[in] thrCount The number of threads to be used (at least 1).
+ *
+ * \param[in] comp comp(a, b) is true if a ranks below b.  The default
+ * (std::less) yields the k largest values.
+ *
+ * \return The (at most k) best distinct values, best first.  Fewer
+ * than k values are returned if the list has fewer distinct values.
+ */
+template <typename T, typename Compare = std::less<T>>
+std::vector<T> topK(const std::vector<T>& list, const size_t k,
+                    int thrCount, Compare comp = Compare()) {
+    if (k == 0 || list.empty()) {
+        return {};
+    }
+    thrCount = std::max(1, std::min<int>(thrCount, list.size() / 4096 + 1));
+    std::vector<TopKPartial<T, Compare>> parts(thrCount);
+    const size_t count = (list.size() + thrCount - 1) / thrCount;
+
+    std::vector<std::thread> thrList;
+    for (int thr = 0; (thr < thrCount); thr++) {
+        const size_t start = std::min(list.size(), thr * count);
+        const size_t end = std::min(list.size(), start + count);
+        thrList.emplace_back([&, start, end, thr] {
+            topKChunk(list.data() + start, list.data() + end, k, comp,
+                      parts[thr]);
+        });
+    }
+    for (auto& t : thrList) {
+        t.join();
+    }
+
+    // Merge the partial results; add() drops duplicates across threads.
+    TopKPartial<T, Compare> result;
+    for (const auto& part : parts) {
+        for (const T& val : part.best) {
+            result.add(val, k, comp);
+        }
+    }
+    return result.best;
+}
+
+/**
+ * A convenience method to compute the k smallest distinct values.
+ * See topK for the parameters.
+ */
+template <typename T>
+std::vector<T> bottomK(const std::vector<T>& list, const size_t k,
+                       const int thrCount) {
+    return topK(list, k, thrCount, std::greater<T>());
+}
+
+#endif
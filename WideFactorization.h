@@ -0,0 +1,547 @@
+#ifndef WIDE_FACTORIZATION_H
+#define WIDE_FACTORIZATION_H
+
+/**
+ * This source file contains a factorization engine for numbers wider
+ * than 64 bits (see WideInt.h).  It is templated over the number of
+ * limbs so the same code handles 128, 256, 512 bits, etc.  Numbers
+ * that fit in 64 bits are handed to the (much faster) engine in
+ * Factorization.h.  Composites are split with:
+ *
+ *   1. Trial division by the primes below 2^16.
+ *
+ *   2. A bounded run of Pollard-Brent rho, which quickly finds factors
+ *      of up to about 40 bits.
+ *
+ *   3. Lenstra's elliptic-curve method (ECM), whose running time
+ *      depends on the size of the smallest factor (not of n), for the
+ *      medium-sized factors that rho would take too long to find.
+ *
+ * ECM finds factors up to about 30 decimal digits in reasonable time.
+ * Numbers with two larger prime factors (e.g., RSA-style 256-bit
+ * semiprimes) are out of reach of these methods.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "Factorization.h"
+#include "PrimeSieve.h"
+#include "WideInt.h"
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * Arithmetic modulo an odd number n in Montgomery form, i.e., the
+ * value a is represented as a * 2^Bits mod n.  This is the multi-limb
+ * version of the Montgomery class in Factorization.cpp, using the
+ * "coarsely integrated operand scanning" (CIOS) multiplication.
+ *
+ * \tparam Limbs The number of 64-bit limbs.
+ */
+template <size_t Limbs>
+class WideMontgomery {
+public:
+    using Int = WideUInt<Limbs>;
+
+    /** Setup the constants for the given odd modulus. */
+    explicit WideMontgomery(const Int& n) : n(n), nInv(n.words[0]) {
+        // Newton's iteration doubles the correct low bits each time.
+        for (int i = 0; (i < 5); i++) {
+            nInv *= 2 - n.words[0] * nInv;
+        }
+        nInv = 0 - nInv;
+        // 2^(2 * Bits) mod n by doubling 1 that many times.
+        r2 = Int(1);
+        for (int i = 0; (i < 2 * Int::Bits); i++) {
+            r2 = add(r2, r2);
+        }
+        r = mul(r2, Int(1));  // 2^Bits mod n
+    }
+
+    /** Multiply two values in Montgomery form (both below n). */
+    Int mul(const Int& a, const Int& b) const {
+        using u128 = unsigned __int128;
+        uint64_t t[Limbs + 2] = {};
+        for (size_t i = 0; (i < Limbs); i++) {
+            u128 carry = 0;
+            for (size_t j = 0; (j < Limbs); j++) {
+                carry += static_cast<u128>(a.words[j]) * b.words[i] + t[j];
+                t[j]   = static_cast<uint64_t>(carry);
+                carry >>= 64;
+            }
+            carry       += t[Limbs];
+            t[Limbs]     = static_cast<uint64_t>(carry);
+            t[Limbs + 1] = static_cast<uint64_t>(carry >> 64);
+
+            // Add m * n so that the lowest limb becomes 0 and shift.
+            const uint64_t m = t[0] * nInv;
+            carry = (static_cast<u128>(m) * n.words[0] + t[0]) >> 64;
+            for (size_t j = 1; (j < Limbs); j++) {
+                carry   += static_cast<u128>(m) * n.words[j] + t[j];
+                t[j - 1] = static_cast<uint64_t>(carry);
+                carry  >>= 64;
+            }
+            carry        += t[Limbs];
+            t[Limbs - 1]  = static_cast<uint64_t>(carry);
+            t[Limbs]      = t[Limbs + 1] + static_cast<uint64_t>(carry >> 64);
+        }
+        Int result;
+        std::copy(t, t + Limbs, result.words.begin());
+        if (t[Limbs] != 0 || result >= n) {
+            result -= n;
+        }
+        return result;
+    }
+
+    Int add(const Int& a, const Int& b) const {
+        Int s = a;
+        if (s.addCarry(b) != 0 || s >= n) {
+            s -= n;
+        }
+        return s;
+    }
+
+    Int sub(const Int& a, const Int& b) const {
+        Int d = a;
+        if (d.subBorrow(b) != 0) {
+            d += n;
+        }
+        return d;
+    }
+
+    Int toMont(const Int& a) const { return mul(a < n ? a : a % n, r2); }
+
+    Int fromMont(const Int& a) const { return mul(a, Int(1)); }
+
+    Int one() const { return r; }
+
+    Int pow(Int base, const Int& exp) const {
+        Int result = r;
+        for (int i = exp.bitLength() - 1; (i >= 0); i--) {
+            result = mul(result, result);
+            if (exp.bit(i)) {
+                result = mul(result, base);
+            }
+        }
+        return result;
+    }
+
+    const Int n;
+
+private:
+    uint64_t nInv;
+    Int r, r2;
+};
+
+/**
+ * Determine if a number is (probably) prime.  Numbers that fit in 64
+ * bits use the exact isPrime64.  Wider numbers use Miller-Rabin with
+ * the first 20 primes as bases; a composite passes with probability
+ * below 4^-20 (no wider composite that does is known).
+ *
+ * \param[in] n The number to be checked.
+ *
+ * \return True if n is (probably) prime.
+ */
+template <size_t Limbs>
+bool isProbablePrime(const WideUInt<Limbs>& n) {
+    using Int = WideUInt<Limbs>;
+    if (n.fitsIn64()) {
+        return isPrime64(n.low64());
+    }
+    const uint64_t Bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37,
+                              41, 43, 47, 53, 59, 61, 67, 71};
+    for (const uint64_t p : Bases) {
+        if (n.modSmall(p) == 0) {
+            return false;  // n is wider than p
+        }
+    }
+
+    const WideMontgomery<Limbs> mont(n);
+    const Int one = mont.one(), minusOne = mont.sub(Int(0), one);
+    const Int nm1 = n - Int(1);
+    const int shift = nm1.countTrailingZeros();
+    const Int d = nm1 >> shift;
+    for (const uint64_t base : Bases) {
+        Int x = mont.pow(mont.toMont(Int(base)), d);
+        if (x == one || x == minusOne) {
+            continue;
+        }
+        int i = 1;
+        for (; (i < shift) && (x != minusOne); i++) {
+            x = mont.mul(x, x);
+        }
+        if (x != minusOne) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Try to find a factor of a composite number with Pollard-Brent rho.
+ * This is the multi-limb version of pollardBrent in Factorization.h
+ * with a limit on the work done, since rho needs about sqrt(p) steps
+ * to find the factor p.
+ *
+ * \param[in] n An odd composite number.
+ *
+ * \param[in] maxSteps The (approximate) largest number of steps.
+ *
+ * \return A factor of n that is neither 1 nor n, or 1 if none was
+ * found within maxSteps.
+ */
+template <size_t Limbs>
+WideUInt<Limbs> pollardBrent(const WideUInt<Limbs>& n,
+                             const uint64_t maxSteps) {
+    using Int = WideUInt<Limbs>;
+    const WideMontgomery<Limbs> mont(n);
+    const uint64_t block = 128;
+    const Int mc = mont.toMont(Int(1));
+    auto f = [&](const Int& y) { return mont.add(mont.mul(y, y), mc); };
+    auto diff = [](const Int& a, const Int& b) {
+        return a > b ? a - b : b - a;
+    };
+
+    Int x, y = mont.toMont(Int(2)), ys = y, q = mont.one(), g(1);
+    uint64_t steps = 0;
+    for (uint64_t r = 1; (g == Int(1)) && (steps < maxSteps); r <<= 1) {
+        x = y;
+        for (uint64_t i = 0; (i < r); i++) {
+            y = f(y);
+        }
+        for (uint64_t k = 0; (k < r) && (g == Int(1)); k += block) {
+            ys = y;
+            for (uint64_t i = 0; (i < std::min(block, r - k)); i++) {
+                y = f(y);
+                q = mont.mul(q, diff(x, y));
+            }
+            g = gcd(q, n);
+        }
+        steps += 2 * r;
+    }
+    if (g == n) {
+        do {
+            ys = f(ys);
+            g  = gcd(diff(x, ys), n);
+        } while (g == Int(1));
+    }
+    return (g == n) ? Int(1) : g;
+}
+
+/**
+ * A point on a Montgomery curve By^2 = x^3 + Ax^2 + x in projective
+ * (X : Z) coordinates; y is not needed.
+ */
+template <size_t Limbs>
+struct EcmPoint {
+    WideUInt<Limbs> x, z;
+};
+
+/**
+ * The x-only arithmetic on one Montgomery curve (modulo n).  The curve
+ * constant (A + 2) / 4 is kept as the fraction a24Num / a24Den so that
+ * no modular inverse is needed.
+ */
+template <size_t Limbs>
+class EcmCurve {
+public:
+    using Int   = WideUInt<Limbs>;
+    using Point = EcmPoint<Limbs>;
+
+    /** Create the curve for a given sigma using Suyama's
+        parametrization, which gives group orders divisible by 12.
+
+        \param[in] mont The arithmetic modulo n.
+
+        \param[in] sigma The curve parameter (at least 6).
+
+        \param[out] start The starting point on the curve.
+    */
+    EcmCurve(const WideMontgomery<Limbs>& mont, const uint64_t sigma,
+             Point& start) : mont(mont) {
+        const Int s = mont.toMont(Int(sigma));
+        const Int u = mont.sub(mont.mul(s, s), mont.toMont(Int(5)));
+        const Int v = mont.add(mont.add(s, s), mont.add(s, s));
+        const Int u3 = mont.mul(mont.mul(u, u), u);
+        const Int vmu = mont.sub(v, u);
+        start = {u3, mont.mul(mont.mul(v, v), v)};
+        // (A + 2) / 4 = (v - u)^3 (3u + v) / (16 u^3 v)
+        a24Num = mont.mul(mont.mul(mont.mul(vmu, vmu), vmu),
+                          mont.add(mont.add(mont.add(u, u), u), v));
+        const Int u3v  = mont.mul(u3, v);
+        const Int u3v4 = mont.add(mont.add(u3v, u3v), mont.add(u3v, u3v));
+        a24Den = mont.add(mont.add(u3v4, u3v4), mont.add(u3v4, u3v4));
+    }
+
+    /** Compute 2P. */
+    Point dbl(const Point& p) const {
+        const Int s  = mont.add(p.x, p.z), d = mont.sub(p.x, p.z);
+        const Int s2 = mont.mul(s, s), d2 = mont.mul(d, d);
+        const Int t  = mont.sub(s2, d2);  // 4xz
+        const Int bd2 = mont.mul(a24Den, d2);
+        return {mont.mul(s2, bd2),
+                mont.mul(t, mont.add(bd2, mont.mul(a24Num, t)))};
+    }
+
+    /** Compute P + Q given their difference P - Q. */
+    Point add(const Point& p, const Point& q, const Point& diff) const {
+        const Int u = mont.mul(mont.sub(p.x, p.z), mont.add(q.x, q.z));
+        const Int v = mont.mul(mont.add(p.x, p.z), mont.sub(q.x, q.z));
+        const Int s = mont.add(u, v), d = mont.sub(u, v);
+        return {mont.mul(diff.z, mont.mul(s, s)),
+                mont.mul(diff.x, mont.mul(d, d))};
+    }
+
+    /** Compute kP (k >= 1) with the Montgomery ladder. */
+    Point mul(const Point& p, const uint64_t k) const {
+        Point r0 = p, r1 = dbl(p);
+        for (int i = 62 - __builtin_clzll(k); (i >= 0); i--) {
+            if ((k >> i) & 1) {
+                r0 = add(r1, r0, p);
+                r1 = dbl(r1);
+            } else {
+                r1 = add(r0, r1, p);
+                r0 = dbl(r0);
+            }
+        }
+        return r0;
+    }
+
+private:
+    const WideMontgomery<Limbs>& mont;
+    Int a24Num, a24Den;
+};
+
+/** The largest stage-2 bound used by ecmFactor. */
+const uint64_t EcmMaxB2 = 25000000;
+
+/**
+ * Run the elliptic-curve method on one curve.
+ *
+ *   - Stage 1 multiplies the starting point by every prime power up to
+ *     B1; a factor p is found if the group order modulo p is B1-smooth.
+ *
+ *   - Stage 2 allows one extra prime q in (B1, B2] using a baby-step /
+ *     giant-step scheme with D = 210: q = mD +/- j, and [mD]Q equals
+ *     +/-[j]Q modulo p exactly when p divides X_mD Z_j - X_j Z_mD.
+ *
+ * \param[in] mont The arithmetic modulo the number n to be factored.
+ *
+ * \param[in] sigma The curve parameter.
+ *
+ * \param[in] b1 The stage 1 bound (at least 2D = 420).
+ *
+ * \param[in] b2 The stage 2 bound (at most EcmMaxB2).
+ *
+ * \return A factor of n that is neither 1 nor n, or 1 if the curve
+ * did not find one.
+ */
+template <size_t Limbs>
+WideUInt<Limbs> ecmCurve(const WideMontgomery<Limbs>& mont,
+                         const uint64_t sigma, const uint64_t b1,
+                         const uint64_t b2) {
+    using Int   = WideUInt<Limbs>;
+    using Point = EcmPoint<Limbs>;
+    static const std::vector<uint32_t> primes =
+        PrimeSieve::instance().primes(EcmMaxB2);
+    const Int& n = mont.n;
+    auto found = [&](const Int& g) { return g != Int(1) && g != n; };
+
+    Point q;
+    const EcmCurve<Limbs> curve(mont, sigma, q);
+    size_t i = 0;
+    for (; (i < primes.size()) && (primes[i] <= b1); i++) {
+        uint64_t pk = primes[i];
+        while (pk * primes[i] <= b1) {
+            pk *= primes[i];
+        }
+        q = curve.mul(q, pk);
+    }
+    Int g = gcd(q.z, n);
+    if (found(g) || g == n || i == primes.size()) {
+        return found(g) ? g : Int(1);
+    }
+
+    // Baby steps [j]Q for odd j < D / 2, giant steps [mD]Q.
+    const uint64_t D = 210;
+    std::vector<Point> baby(D / 2 + 1);
+    const Point q2 = curve.dbl(q);
+    baby[1] = q;
+    baby[3] = curve.add(q2, q, q);
+    for (uint64_t j = 5; (j < baby.size()); j += 2) {
+        baby[j] = curve.add(baby[j - 2], q2, baby[j - 4]);
+    }
+    const Point giant = curve.mul(q, D);
+    uint64_t m = (primes[i] + D / 2) / D;
+    Point prev = curve.mul(q, (m - 1) * D), cur = curve.mul(q, m * D);
+    Int acc = mont.one();
+    for (; (i < primes.size()) && (primes[i] <= b2); i++) {
+        for (; (primes[i] > m * D + D / 2); m++) {
+            const Point next = curve.add(cur, giant, prev);
+            prev = cur;
+            cur  = next;
+        }
+        const uint64_t j = (primes[i] > m * D) ? primes[i] - m * D :
+            m * D - primes[i];
+        acc = mont.mul(acc, mont.sub(mont.mul(cur.x, baby[j].z),
+                                     mont.mul(baby[j].x, cur.z)));
+    }
+    g = gcd(acc, n);
+    return found(g) ? g : Int(1);
+}
+
+/**
+ * Find a factor of a composite number with ECM.  The bounds follow the
+ * usual schedule for factors of 15, 20, 25, and 30 digits, moving on to
+ * the next one after the expected number of curves.
+ *
+ * \param[in] n An odd composite number that is not a prime power.
+ *
+ * \return A factor of n that is neither 1 nor n, or 1 if none was
+ * found (with very high probability n has no factor below 30 digits).
+ */
+template <size_t Limbs>
+WideUInt<Limbs> ecmFactor(const WideUInt<Limbs>& n) {
+    struct Level { uint64_t b1, curves; };
+    const Level Levels[] = {{2000, 25}, {11000, 90}, {50000, 300},
+                            {250000, 700}};
+    const WideMontgomery<Limbs> mont(n);
+    uint64_t sigma = 6;
+    for (const Level& level : Levels) {
+        for (uint64_t c = 0; (c < level.curves); c++, sigma++) {
+            const WideUInt<Limbs> g = ecmCurve(mont, sigma, level.b1,
+                                               100 * level.b1);
+            if (g != WideUInt<Limbs>(1)) {
+                return g;
+            }
+        }
+    }
+    return WideUInt<Limbs>(1);
+}
+
+/**
+ * Helper method to find the integer k-th root of n if n is a perfect
+ * k-th power.  ECM and rho cannot split prime powers efficiently.
+ *
+ * \param[in] n The number to be checked.
+ *
+ * \param[in] k The root (at least 2).
+ *
+ * \return The root, or 0 if n is not a perfect k-th power.
+ */
+template <size_t Limbs>
+WideUInt<Limbs> exactRoot(const WideUInt<Limbs>& n, const int k) {
+    using Int = WideUInt<Limbs>;
+    // Compare x^k with n (-1, 0, or 1) without overflowing.
+    auto compare = [&](const Int& x) {
+        const Int limit = n / x;
+        Int p(1);
+        for (int i = 0; (i < k); i++) {
+            if (p > limit) {
+                return 1;
+            }
+            p *= x;
+        }
+        return (p < n) ? -1 : (p == n) ? 0 : 1;
+    };
+    // Binary search on [1, 2^(bits / k + 1)).
+    Int lo(1), hi(1);
+    hi <<= n.bitLength() / k + 1;
+    while (lo < hi) {
+        const Int mid = lo + ((hi - lo) >> 1);
+        const int cmp = compare(mid);
+        if (cmp == 0) {
+            return mid;
+        }
+        if (cmp > 0) {
+            hi = mid;
+        } else {
+            lo = mid + Int(1);
+        }
+    }
+    return Int(0);
+}
+
+/**
+ * Helper method to recursively split n into its prime factors.
+ *
+ * \param[in] n A number without prime factors below 2^16.
+ *
+ * \param[out] factors The list to which prime factors are added.
+ */
+template <size_t Limbs>
+void splitWide(const WideUInt<Limbs>& n,
+               std::vector<WideUInt<Limbs>>& factors) {
+    using Int = WideUInt<Limbs>;
+    if (n.fitsIn64()) {
+        uint64_t small[MaxFactors];
+        const size_t count = primeFactors(n.low64(), small);
+        factors.insert(factors.end(), small, small + count);
+        return;
+    }
+    if (isProbablePrime(n)) {
+        factors.push_back(n);
+        return;
+    }
+    for (int k = 2; (k <= n.bitLength() / 16); k++) {
+        const Int root = exactRoot(n, k);
+        if (!root.isZero()) {
+            for (int i = 0; (i < k); i++) {
+                splitWide(root, factors);
+            }
+            return;
+        }
+    }
+    Int d = pollardBrent(n, 1 << 20);
+    if (d == Int(1)) {
+        d = ecmFactor(n);
+    }
+    if (d == Int(1)) {
+        throw std::runtime_error("Unable to factor " + n.toString());
+    }
+    splitWide(d, factors);
+    splitWide(n / d, factors);
+}
+
+/**
+ * Compute the full prime factorization of a wide number.  This is the
+ * multi-limb version of primeFactors in Factorization.h.
+ *
+ * \param[in] n The number to be factorized.
+ *
+ * \return The prime factors of n in ascending order, repeated as per
+ * their multiplicity.  The list is empty for 0 and 1.  A
+ * std::runtime_error is thrown if n has two or more prime factors too
+ * large for ECM (about 30 digits or more).
+ */
+template <size_t Limbs>
+std::vector<WideUInt<Limbs>> primeFactors(WideUInt<Limbs> n) {
+    std::vector<WideUInt<Limbs>> factors;
+    if (n <= WideUInt<Limbs>(1)) {
+        return factors;
+    }
+    static const std::vector<uint32_t> trialPrimes =
+        PrimeSieve::instance().primes(1 << 16);
+    for (const uint64_t p : trialPrimes) {
+        if (n.fitsIn64()) {
+            break;  // The 64-bit engine takes over in splitWide
+        }
+        while (n.modSmall(p) == 0) {
+            n.divSmall(p);
+            factors.push_back(p);
+        }
+    }
+    if (n > WideUInt<Limbs>(1)) {
+        splitWide(n, factors);
+    }
+    std::sort(factors.begin(), factors.end());
+    return factors;
+}
+
+#endif
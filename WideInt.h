@@ -0,0 +1,379 @@
+#ifndef WIDE_INT_H
+#define WIDE_INT_H
+
+/**
+ * This source file contains the definition for the WideUInt class
+ * template, an unsigned integer made of a fixed number of 64-bit limbs
+ * (e.g., WideUInt<2> is 128 bits and WideUInt<8> is 512 bits).  Only
+ * the operations needed for factorization are provided.  Arithmetic
+ * wraps modulo 2^(64 * Limbs) like the built-in unsigned types.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/**
+ * An unsigned integer of 64 * Limbs bits.
+ *
+ * \tparam Limbs The number of 64-bit words (at least 1).
+ */
+template <size_t Limbs>
+class WideUInt {
+    static_assert(Limbs >= 1, "WideUInt needs at least one limb");
+
+public:
+    /** The number of bits in this type. */
+    static const int Bits = 64 * Limbs;
+
+    /** The constructor to create a number from a 64-bit value. */
+    WideUInt(const uint64_t val = 0) : words{} { words[0] = val; }
+
+    /** The constructor to convert from another width.  The value is
+        truncated if it does not fit.
+    */
+    template <size_t Other>
+    explicit WideUInt(const WideUInt<Other>& other) : words{} {
+        std::copy_n(other.words.begin(), std::min(Limbs, Other),
+                    words.begin());
+    }
+
+    /** Convert a decimal string to a number.
+
+        \param[in] str The decimal digits (no sign or spaces).
+
+        \return The number.  A std::runtime_error is thrown if str is
+        empty, has a non-digit, or does not fit in Bits bits.
+    */
+    static WideUInt fromString(const std::string& str) {
+        if (str.empty()) {
+            throw std::runtime_error("Invalid number: \"\"");
+        }
+        WideUInt num;
+        for (const char c : str) {
+            if (c < '0' || c > '9') {
+                throw std::runtime_error("Invalid number: " + str);
+            }
+            if (num.mulSmall(10) != 0 || num.addSmall(c - '0') != 0) {
+                throw std::runtime_error("Number too large: " + str);
+            }
+        }
+        return num;
+    }
+
+    /** Convert the number to a decimal string. */
+    std::string toString() const {
+        const uint64_t Chunk = 10000000000000000000ULL;  // 10^19
+        std::string str;
+        WideUInt num = *this;
+        do {
+            uint64_t rem = num.divSmall(Chunk);
+            const bool last = num.isZero();
+            for (int i = 0; (i < 19) && (!last || rem != 0); i++) {
+                str += static_cast<char>('0' + rem % 10);
+                rem /= 10;
+            }
+        } while (!num.isZero());
+        if (str.empty()) {
+            str = "0";
+        }
+        return std::string(str.rbegin(), str.rend());
+    }
+
+    bool isZero() const {
+        for (const uint64_t w : words) {
+            if (w != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isOdd() const { return words[0] & 1; }
+
+    /** Check if the number is below 2^64 (i.e., fits in low64()). */
+    bool fitsIn64() const { return bitLength() <= 64; }
+
+    /** Obtain the lowest 64 bits of the number. */
+    uint64_t low64() const { return words[0]; }
+
+    /** Obtain the number of bits needed for the number (0 for 0). */
+    int bitLength() const {
+        for (int i = Limbs - 1; (i >= 0); i--) {
+            if (words[i] != 0) {
+                return 64 * i + 64 - __builtin_clzll(words[i]);
+            }
+        }
+        return 0;
+    }
+
+    /** Obtain the number of trailing zero bits (Bits for 0). */
+    int countTrailingZeros() const {
+        for (size_t i = 0; (i < Limbs); i++) {
+            if (words[i] != 0) {
+                return 64 * i + __builtin_ctzll(words[i]);
+            }
+        }
+        return Bits;
+    }
+
+    bool bit(const int i) const { return (words[i / 64] >> (i % 64)) & 1; }
+
+    void setBit(const int i) { words[i / 64] |= 1ULL << (i % 64); }
+
+    /** Multiply by a 64-bit value in place.
+
+        \return The part of the product that did not fit (the carry).
+    */
+    uint64_t mulSmall(const uint64_t m) {
+        unsigned __int128 carry = 0;
+        for (auto& w : words) {
+            carry += static_cast<unsigned __int128>(w) * m;
+            w      = static_cast<uint64_t>(carry);
+            carry >>= 64;
+        }
+        return static_cast<uint64_t>(carry);
+    }
+
+    /** Add a 64-bit value in place.
+
+        \return The carry out of the top limb (0 or 1).
+    */
+    uint64_t addSmall(const uint64_t a) {
+        uint64_t carry = a;
+        for (size_t i = 0; (i < Limbs) && (carry != 0); i++) {
+            words[i] += carry;
+            carry = (words[i] < carry);
+        }
+        return carry;
+    }
+
+    /** Divide by a (non-zero) 64-bit value in place.
+
+        \return The remainder.
+    */
+    uint64_t divSmall(const uint64_t d) {
+        unsigned __int128 rem = 0;
+        for (int i = Limbs - 1; (i >= 0); i--) {
+            rem      = (rem << 64) | words[i];
+            words[i] = static_cast<uint64_t>(rem / d);
+            rem     %= d;
+        }
+        return static_cast<uint64_t>(rem);
+    }
+
+    /** Obtain the remainder of dividing by a (non-zero) 64-bit value. */
+    uint64_t modSmall(const uint64_t d) const {
+        unsigned __int128 rem = 0;
+        for (int i = Limbs - 1; (i >= 0); i--) {
+            rem = ((rem << 64) | words[i]) % d;
+        }
+        return static_cast<uint64_t>(rem);
+    }
+
+    /** Add in place.
+
+        \return The carry out of the top limb (0 or 1).
+    */
+    uint64_t addCarry(const WideUInt& other) {
+        uint64_t carry = 0;
+        for (size_t i = 0; (i < Limbs); i++) {
+            const uint64_t s = words[i] + carry;
+            carry    = (s < carry);
+            words[i] = s + other.words[i];
+            carry   += (words[i] < s);
+        }
+        return carry;
+    }
+
+    /** Subtract in place.
+
+        \return The borrow out of the top limb (0 or 1).
+    */
+    uint64_t subBorrow(const WideUInt& other) {
+        uint64_t borrow = 0;
+        for (size_t i = 0; (i < Limbs); i++) {
+            const uint64_t d = words[i] - other.words[i];
+            const uint64_t b = (words[i] < other.words[i]);
+            words[i] = d - borrow;
+            borrow   = b + (d < borrow);
+        }
+        return borrow;
+    }
+
+    WideUInt& operator+=(const WideUInt& other) {
+        addCarry(other);
+        return *this;
+    }
+
+    WideUInt& operator-=(const WideUInt& other) {
+        subBorrow(other);
+        return *this;
+    }
+
+    WideUInt& operator<<=(const int shift) {
+        const int limbShift = shift / 64, bitShift = shift % 64;
+        for (int i = Limbs - 1; (i >= 0); i--) {
+            uint64_t w = 0;
+            if (i - limbShift >= 0) {
+                w = words[i - limbShift] << bitShift;
+                if (bitShift != 0 && i - limbShift - 1 >= 0) {
+                    w |= words[i - limbShift - 1] >> (64 - bitShift);
+                }
+            }
+            words[i] = w;
+        }
+        return *this;
+    }
+
+    WideUInt& operator>>=(const int shift) {
+        const int limbShift = shift / 64, bitShift = shift % 64;
+        for (size_t i = 0; (i < Limbs); i++) {
+            uint64_t w = 0;
+            if (i + limbShift < Limbs) {
+                w = words[i + limbShift] >> bitShift;
+                if (bitShift != 0 && i + limbShift + 1 < Limbs) {
+                    w |= words[i + limbShift + 1] << (64 - bitShift);
+                }
+            }
+            words[i] = w;
+        }
+        return *this;
+    }
+
+    /** Multiply in place, keeping the low Bits bits of the product. */
+    WideUInt& operator*=(const WideUInt& other) {
+        WideUInt prod;
+        for (size_t i = 0; (i < Limbs); i++) {
+            unsigned __int128 carry = 0;
+            for (size_t j = 0; (i + j < Limbs); j++) {
+                carry += static_cast<unsigned __int128>(words[i]) *
+                    other.words[j] + prod.words[i + j];
+                prod.words[i + j] = static_cast<uint64_t>(carry);
+                carry >>= 64;
+            }
+        }
+        return *this = prod;
+    }
+
+    /** Compute the quotient and remainder with shift-and-subtract long
+        division.  This is slow compared to the other operations but is
+        only needed once per factor found.
+
+        \param[in] num The dividend.
+
+        \param[in] den The divisor.  A std::runtime_error is thrown if
+        it is zero.
+
+        \param[out] quot The quotient.
+
+        \param[out] rem The remainder.
+    */
+    static void divMod(const WideUInt& num, const WideUInt& den,
+                       WideUInt& quot, WideUInt& rem) {
+        if (den.isZero()) {
+            throw std::runtime_error("Division by zero");
+        }
+        quot = rem = WideUInt();
+        for (int i = num.bitLength() - 1; (i >= 0); i--) {
+            const bool overflow = rem.bit(Bits - 1);
+            rem <<= 1;
+            rem.words[0] |= num.bit(i);
+            if (overflow || rem >= den) {
+                rem -= den;
+                quot.setBit(i);
+            }
+        }
+    }
+
+    friend WideUInt operator+(WideUInt a, const WideUInt& b) { return a += b; }
+    friend WideUInt operator-(WideUInt a, const WideUInt& b) { return a -= b; }
+    friend WideUInt operator*(WideUInt a, const WideUInt& b) { return a *= b; }
+    friend WideUInt operator<<(WideUInt a, const int s) { return a <<= s; }
+    friend WideUInt operator>>(WideUInt a, const int s) { return a >>= s; }
+
+    friend WideUInt operator/(const WideUInt& a, const WideUInt& b) {
+        WideUInt quot, rem;
+        divMod(a, b, quot, rem);
+        return quot;
+    }
+
+    friend WideUInt operator%(const WideUInt& a, const WideUInt& b) {
+        WideUInt quot, rem;
+        divMod(a, b, quot, rem);
+        return rem;
+    }
+
+    friend bool operator==(const WideUInt& a, const WideUInt& b) {
+        return a.words == b.words;
+    }
+
+    friend bool operator!=(const WideUInt& a, const WideUInt& b) {
+        return a.words != b.words;
+    }
+
+    friend bool operator<(const WideUInt& a, const WideUInt& b) {
+        for (int i = Limbs - 1; (i >= 0); i--) {
+            if (a.words[i] != b.words[i]) {
+                return a.words[i] < b.words[i];
+            }
+        }
+        return false;
+    }
+
+    friend bool operator>(const WideUInt& a, const WideUInt& b) {
+        return b < a;
+    }
+
+    friend bool operator<=(const WideUInt& a, const WideUInt& b) {
+        return !(b < a);
+    }
+
+    friend bool operator>=(const WideUInt& a, const WideUInt& b) {
+        return !(a < b);
+    }
+
+    /** The limbs, least significant first. */
+    std::array<uint64_t, Limbs> words;
+};
+
+/**
+ * Compute the greatest common divisor with the binary (Stein's)
+ * algorithm, which needs only shifts and subtractions.
+ *
+ * \param[in] a The first number.
+ *
+ * \param[in] b The second number.
+ *
+ * \return gcd(a, b); gcd(0, b) is b.
+ */
+template <size_t Limbs>
+WideUInt<Limbs> gcd(WideUInt<Limbs> a, WideUInt<Limbs> b) {
+    if (a.isZero()) {
+        return b;
+    }
+    if (b.isZero()) {
+        return a;
+    }
+    const int shift = std::min(a.countTrailingZeros(), b.countTrailingZeros());
+    a >>= a.countTrailingZeros();
+    while (!b.isZero()) {
+        b >>= b.countTrailingZeros();
+        if (a > b) {
+            std::swap(a, b);
+        }
+        b -= a;
+    }
+    return a <<= shift;
+}
+
+#endif
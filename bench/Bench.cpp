@@ -0,0 +1,313 @@
+// Copyright Brendan Han 2023
+
+/**
+ * This source file contains the implementation for the various
+ * methods defined in the BenchSuite class and the data generators
+ * declared in Bench.h.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include "Bench.h"
+
+namespace {
+
+/** The seed for all generated data, so every run sees the same data. */
+const uint64_t Seed = 381;
+
+/** Shortcut for the 128-bit type used for modular products. */
+using u128 = unsigned __int128;
+
+/**
+ * Helper method to compute (base ^ exp) mod n.
+ */
+uint64_t powMod(uint64_t base, uint64_t exp, const uint64_t n) {
+    uint64_t result = 1;
+    for (base %= n; exp != 0; exp >>= 1) {
+        if (exp & 1) {
+            result = static_cast<u128>(result) * base % n;
+        }
+        base = static_cast<u128>(base) * base % n;
+    }
+    return result;
+}
+
+/**
+ * Helper method to check if a number is prime (deterministic
+ * Miller-Rabin).  Kept separate from Factorization.h so that the data
+ * does not depend on the code being measured.
+ */
+bool isPrime(const uint64_t n) {
+    if (n < 2) {
+        return false;
+    }
+    for (const uint64_t p : {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}) {
+        if (n % p == 0) {
+            return n == p;
+        }
+    }
+    const int shift = __builtin_ctzll(n - 1);
+    const uint64_t d = (n - 1) >> shift;
+    for (const uint64_t a : {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37}) {
+        uint64_t x = powMod(a, d, n);
+        if (x == 1 || x == n - 1) {
+            continue;
+        }
+        for (int i = 1; (i < shift) && (x != n - 1); i++) {
+            x = static_cast<u128>(x) * x % n;
+        }
+        if (x != n - 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Helper method to open a file for writing, throwing on failure.
+ */
+std::ofstream create(const std::string& path) {
+    std::ofstream os(path);
+    if (!os.good()) {
+        throw std::runtime_error("Unable to create " + path);
+    }
+    return os;
+}
+
+}  // namespace
+
+BenchSuite::BenchSuite(const std::string& suite, int argc, char *argv[]) :
+    suite(suite) {
+    for (int i = 1; (i < argc); i++) {
+        const std::string opt = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + opt);
+        }
+        const std::string val = argv[++i];
+        if (opt == "--json") {
+            jsonPath = val;
+        } else if (opt == "--scale") {
+            scale = std::stod(val);
+        } else if (opt == "--reps") {
+            repCount = std::max(1, std::stoi(val));
+        } else if (opt == "--dir") {
+            dataDir = val;
+            mkdir(dataDir.c_str(), 0755);
+        } else {
+            throw std::runtime_error("Unknown option " + opt);
+        }
+    }
+    // Made absolute so that paths stay valid if a benchmark changes
+    // to the data directory (e.g., HW03).
+    char* const absDir = realpath(dataDir.c_str(), nullptr);
+    if (absDir != nullptr) {
+        dataDir = absDir;
+        free(absDir);
+    }
+    char* const cwd = getcwd(nullptr, 0);
+    if (cwd != nullptr && !jsonPath.empty() && jsonPath[0] != '/') {
+        jsonPath = std::string(cwd) + "/" + jsonPath;
+    }
+    free(cwd);
+}
+
+BenchSuite::~BenchSuite() {
+    if (jsonPath.empty()) {
+        writeJson(std::cout);
+    } else {
+        std::ofstream os(jsonPath);
+        writeJson(os);
+    }
+}
+
+void BenchSuite::run(const std::string& name, const size_t items,
+                     const std::function<void()>& body) {
+    using Clock = std::chrono::steady_clock;
+    body();  // Warm-up
+    std::vector<double> times;
+    for (int rep = 0; (rep < repCount); rep++) {
+        const auto start = Clock::now();
+        body();
+        const std::chrono::duration<double, std::milli> elapsed =
+            Clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::sort(times.begin(), times.end());
+    BenchResult res;
+    res.name     = name;
+    res.items    = items;
+    res.reps     = repCount;
+    res.minMs    = times.front();
+    res.medianMs = times[times.size() / 2];
+    res.meanMs   = std::accumulate(times.begin(), times.end(), 0.0) /
+        times.size();
+    results.push_back(res);
+    std::cerr << suite << '.' << name << ": " << res.medianMs << " ms\n";
+}
+
+const BenchResult& BenchSuite::last() const {
+    if (results.empty()) {
+        throw std::runtime_error("No benchmark has been run");
+    }
+    return results.back();
+}
+
+void BenchSuite::addMetric(const std::string& key, const double value) {
+    if (results.empty()) {
+        throw std::runtime_error("No benchmark has been run");
+    }
+    results.back().metrics.emplace_back(key, value);
+    std::cerr << suite << '.' << results.back().name << '.' << key << ": "
+              << value << '\n';
+}
+
+void BenchSuite::writeJson(std::ostream& os) const {
+    os << std::fixed << std::setprecision(3)
+       << "{\n  \"suite\": \"" << suite << "\",\n  \"scale\": " << scale
+       << ",\n  \"results\": [";
+    for (size_t i = 0; (i < results.size()); i++) {
+        const BenchResult& r = results[i];
+        os << (i == 0 ? "\n" : ",\n")
+           << "    {\"name\": \"" << r.name << "\", \"items\": " << r.items
+           << ", \"reps\": " << r.reps << ", \"min_ms\": " << r.minMs
+           << ", \"median_ms\": " << r.medianMs << ", \"mean_ms\": "
+           << r.meanMs << ", \"items_per_sec\": "
+           << (r.minMs > 0 ? r.items * 1000.0 / r.minMs : 0);
+        for (const auto& metric : r.metrics) {
+            os << ", \"" << metric.first << "\": " << metric.second;
+        }
+        os << "}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+size_t BenchSuite::scaled(const size_t base) const {
+    return std::max<size_t>(1, base * scale);
+}
+
+std::string BenchSuite::path(const std::string& name) const {
+    return dataDir + "/" + name;
+}
+
+double percentile(std::vector<double> values, const double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    const size_t rank = std::min(values.size() - 1,
+                                 static_cast<size_t>(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank];
+}
+
+void makeHttpData(const std::string& path, const size_t count) {
+    std::ofstream os = create(path);
+    os << "HTTP/1.1 200 OK\r\nServer: BenchData\r\n"
+       << "Content-Type: text/plain\r\n\r\n";
+    std::mt19937 rng(Seed);
+    std::uniform_int_distribution<int> dist(-1000000, 1000000);
+    for (size_t i = 0; (i < count); i++) {
+        os << dist(rng) << ((i % 10 == 9) ? '\n' : ' ');
+    }
+}
+
+void dropPageCache(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+void makePasswd(const std::string& path, const size_t users) {
+    std::ofstream os = create(path);
+    for (size_t i = 0; (i < users); i++) {
+        const size_t uid = 1000 + i;
+        os << "user" << uid << ":x:" << uid << ':' << uid << ":Bench User "
+           << i << ":/home/user" << uid << ":/bin/bash\n";
+    }
+}
+
+void makeGroups(const std::string& path, const size_t groups,
+                const size_t users, const size_t members) {
+    std::ofstream os = create(path);
+    std::mt19937 rng(Seed);
+    std::uniform_int_distribution<size_t> dist(0, users - 1);
+    for (size_t i = 0; (i < groups); i++) {
+        os << "group" << i << ":x:" << (2000 + i) << ':';
+        for (size_t m = 0; (m < members); m++) {
+            os << (m == 0 ? "" : ",") << (1000 + dist(rng));
+        }
+        os << '\n';
+    }
+}
+
+void makeAuthLog(const std::string& dir, const size_t lines) {
+    const char* Months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun"};
+    std::mt19937 rng(Seed);
+    std::ofstream users = create(dir + "/authorized_users.txt");
+    std::ofstream banned = create(dir + "/banned_ips.txt");
+    for (int i = 0; (i < 50); i++) {
+        users << "user" << i << '\n';
+        banned << "10.0." << (i / 10) << '.' << i << '\n';
+    }
+
+    std::ofstream os = create(dir + "/auth.log");
+    os << "HTTP/1.1 200 OK\r\nServer: BenchData\r\n"
+       << "Content-Type: text/plain\r\n\r\n";
+    for (size_t i = 0; (i < lines); i++) {
+        const bool failed = (rng() % 4 == 0);
+        os << Months[(i / 100000) % 6] << ' ' << (1 + i / 3600 % 28) << ' '
+           << std::setfill('0') << std::setw(2) << (i / 3600 % 24) << ':'
+           << std::setw(2) << (i / 60 % 60) << ':' << std::setw(2)
+           << (i % 60) << std::setfill(' ') << " bench sshd[" << (1000 + i)
+           << "]: " << (failed ? "Failed" : "Accepted")
+           << " password for user" << (rng() % 200) << " from 10.0."
+           << (rng() % 20) << '.' << (rng() % 100) << " port "
+           << (1024 + rng() % 60000) << " ssh2\n";
+    }
+}
+
+void makeScript(const std::string& path, const size_t jobs,
+                const std::string& cmd) {
+    std::ofstream os = create(path);
+    std::mt19937 rng(Seed);
+    for (size_t i = 0; (i < jobs); i++) {
+        os << "JOB j" << i;
+        if (i > 0) {
+            os << " AFTER j" << (rng() % i);
+            if (i > 1) {
+                os << " j" << (rng() % i);
+            }
+        }
+        os << " RUN " << cmd << '\n';
+    }
+}
+
+std::vector<uint64_t> makeSemiprimes(const size_t count, const int bits) {
+    std::mt19937_64 rng(Seed);
+    const int half = std::max(2, bits / 2);
+    auto randomPrime = [&](const int b) {
+        for (;;) {
+            const uint64_t top = 1ULL << (b - 1);
+            const uint64_t p = (rng() & (top - 1)) | top | 1;
+            if (isPrime(p)) {
+                return p;
+            }
+        }
+    };
+    std::vector<uint64_t> nums;
+    for (size_t i = 0; (i < count); i++) {
+        nums.push_back(randomPrime(half) * randomPrime(bits - half));
+    }
+    return nums;
+}
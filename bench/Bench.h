@@ -0,0 +1,227 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/**
+ * This source file contains the definition for the BenchSuite class
+ * and the synthetic data generators shared by the benchmark programs
+ * (BenchHW01.cpp ... BenchHW05.cpp) in this directory.  Each program
+ * times the hot paths of one homework and prints the results as JSON,
+ * so that the output of two runs (e.g., before and after a change) can
+ * be compared.  The programs are built (and run) by the Makefile in
+ * this directory, e.g., "make -C bench run".
+ *
+ * Every benchmark program accepts the same options:
+ *
+ *   --json <file>  Write the JSON results to a file (default: stdout).
+ *   --scale <x>    Multiply the size of the generated data by x.
+ *   --reps <n>     Number of timed repetitions of each benchmark.
+ *   --dir <path>   Directory for the generated data files.
+ *
+ * Copyright Brendan Han 2023
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ------------------------------------------------------------------- //
+// ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
+// ------------------------------------------------------------------- //
+
+/** The timings of one benchmark. */
+struct BenchResult {
+    /** The name of the benchmark, e.g., "max". */
+    std::string name;
+    /** The number of items (lines, numbers, ...) processed per run. */
+    size_t items = 0;
+    /** The number of timed runs. */
+    int reps = 0;
+    /** The fastest, median, and average run times in milliseconds. */
+    double minMs = 0, medianMs = 0, meanMs = 0;
+    /** Other measurements reported by the benchmark (see addMetric),
+        e.g., {"p99_ms", 12.5}. */
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+/**
+ * A simple benchmark driver: it parses the common command-line
+ * options, runs each benchmark a few times after one warm-up run, and
+ * writes all the results as a single JSON document.
+ */
+class BenchSuite {
+public:
+    /** The constructor parses the common command-line options.
+
+        \param[in] suite The name of the suite (e.g., "HW01").
+
+        \param[in] argc The number of command-line arguments.
+
+        \param[in] argv The command-line arguments.  A
+        std::runtime_error is thrown for an unknown option.
+    */
+    BenchSuite(const std::string& suite, int argc, char *argv[]);
+
+    /** The destructor writes the JSON results (see writeJson). */
+    ~BenchSuite();
+
+    /** Time a benchmark.  The body is run once untimed (to warm up
+        caches and lazily built tables) and then reps() times.
+
+        \param[in] name The name of the benchmark.
+
+        \param[in] items The number of items processed per run, used to
+        report a throughput.
+
+        \param[in] body The code to be timed.
+    */
+    void run(const std::string& name, const size_t items,
+             const std::function<void()>& body);
+
+    /** Add a measurement other than the run time (e.g., a latency
+        percentile or an allocation count) to the results of the last
+        benchmark run.
+
+        \param[in] key The name of the measurement, e.g., "p99_ms".
+
+        \param[in] value The value of the measurement.
+    */
+    void addMetric(const std::string& key, const double value);
+
+    /** Obtain the results of the last benchmark run (see run).  A
+        std::runtime_error is thrown if there is none yet.
+
+        \return The results.
+    */
+    const BenchResult& last() const;
+
+    /** Write the results collected so far as JSON.
+
+        \param[out] os The stream to write to.
+    */
+    void writeJson(std::ostream& os) const;
+
+    /** Obtain a data size multiplied by the --scale option.
+
+        \param[in] base The size at scale 1.
+
+        \return The scaled size (at least 1).
+    */
+    size_t scaled(const size_t base) const;
+
+    /** Obtain the path of a data file in the --dir directory.
+
+        \param[in] name The file name.
+
+        \return The path.
+    */
+    std::string path(const std::string& name) const;
+
+    /** Obtain the number of timed runs of each benchmark. */
+    int reps() const { return repCount; }
+
+private:
+    std::string suite;
+    std::string jsonPath;
+    std::string dataDir = ".";
+    double scale = 1;
+    int repCount = 5;
+    std::vector<BenchResult> results;
+};
+
+/**
+ * Helper to keep the compiler from optimizing away a computed value.
+ *
+ * \param[in] value The value to be kept.
+ */
+template <typename T>
+void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/** Obtain a percentile of a set of measurements.
+
+    \param[in] values The measurements (need not be sorted).
+
+    \param[in] fraction The percentile as a fraction, e.g., 0.99.
+
+    \return The value below which the given fraction of values lie (0
+    if there are none).
+*/
+double percentile(std::vector<double> values, const double fraction);
+
+/** Write a data file in HTTP-response format (headers, a blank line,
+    and then whitespace-separated integers), as read by HW01.
+
+    \param[in] path The file to be created.
+
+    \param[in] count The number of integers.
+*/
+void makeHttpData(const std::string& path, const size_t count);
+
+/** Evict a file from the page cache (posix_fadvise DONTNEED), so
+    that the next read of it comes from the disk.
+
+    \param[in] path The file.
+*/
+void dropPageCache(const std::string& path);
+
+/** Write a passwd-style file ("login:x:uid:gid:...") as read by HW02.
+
+    \param[in] path The file to be created.
+
+    \param[in] users The number of users (uids 1000, 1001, ...).
+*/
+void makePasswd(const std::string& path, const size_t users);
+
+/** Write a groups-style file ("name:x:gid:uid,uid,...") as read by
+    HW02.
+
+    \param[in] path The file to be created.
+
+    \param[in] groups The number of groups.
+
+    \param[in] users The number of users in the matching passwd file.
+
+    \param[in] members The number of members per group.
+*/
+void makeGroups(const std::string& path, const size_t groups,
+                const size_t users, const size_t members);
+
+/** Write an HTTP response with SSH authentication log lines, plus the
+    authorized_users.txt and banned_ips.txt files, as read by HW03.
+
+    \param[in] dir The directory for the files.  The log is written to
+    dir/auth.log.
+
+    \param[in] lines The number of log lines.
+*/
+void makeAuthLog(const std::string& dir, const size_t lines);
+
+/** Write a PARALLEL command script ("JOB ... RUN ...") as read by
+    HW04.  Each job depends on up to two earlier jobs.
+
+    \param[in] path The file to be created.
+
+    \param[in] jobs The number of jobs.
+
+    \param[in] cmd The command run by every job, e.g., "true".
+*/
+void makeScript(const std::string& path, const size_t jobs,
+                const std::string& cmd);
+
+/** Generate products of two random primes of about bits / 2 bits each,
+    the hardest 64-bit inputs for HW05.
+
+    \param[in] count The number of semiprimes.
+
+    \param[in] bits The size of each semiprime (at most 64).
+
+    \return The semiprimes.
+*/
+std::vector<uint64_t> makeSemiprimes(const size_t count, const int bits);
+
+#endif
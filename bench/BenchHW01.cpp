@@ -0,0 +1,96 @@
+// Copyright 2023 Brendan Han
+
+/**
+ * Benchmarks for the hot paths of HW01: max, minVal, processParams,
+ * and the throughput of many concurrent requests, with a thread per
+ * request versus one thread reading all the data files through an
+ * AsyncFileReader (io_uring or pread), on a cold and a warm page
+ * cache.  See Bench.h for the command-line options.
+ *
+ * Build (from the top-level directory):
+ *   g++ -std=c++17 -O2 -I. bench/BenchHW01.cpp bench/Bench.cpp \
+ *       AsyncFileReader.cpp -pthread -o benchHW01
+ */
+
+#include <atomic>
+#include <thread>
+#include "../HW01.cpp"
+#include "Bench.h"
+
+int main(int argc, char *argv[]) {
+    BenchSuite suite("HW01", argc, argv);
+    const size_t count = suite.scaled(5000000);
+    const std::string data = suite.path("bench_data.txt");
+    makeHttpData(data, count);
+
+    suite.run("max", count, [&] { doNotOptimize(max(data)); });
+    suite.run("minVal", count, [&] { doNotOptimize(minVal(data)); });
+
+    // A long POST body with many (partly URL-encoded) parameters.
+    std::string params;
+    for (size_t i = 0; (i < suite.scaled(200)); i++) {
+        params += (i == 0 ? "" : "&") + ("name" + std::to_string(i)) +
+            "=some+value%20with%2Fescapes" + std::to_string(i);
+    }
+    const size_t calls = 1000;
+    suite.run("processParams", calls * suite.scaled(200), [&] {
+        for (size_t i = 0; (i < calls); i++) {
+            doNotOptimize(processParams(params));
+        }
+    });
+
+    // Many concurrent requests, each for its own data file.
+    const size_t requests = 64, perFile = suite.scaled(200000);
+    std::vector<std::string> files;
+    std::vector<bool> min2nd;
+    for (size_t i = 0; (i < requests); i++) {
+        files.push_back(suite.path("bench_req" + std::to_string(i) + ".txt"));
+        makeHttpData(files.back(), perFile);
+        min2nd.push_back(i % 2);
+    }
+    auto threadPerRequest = [&] {
+        std::vector<std::thread> thrs;
+        std::vector<int> results(requests);
+        for (size_t i = 0; (i < requests); i++) {
+            thrs.emplace_back([&, i] {
+                results[i] = min2nd[i] ? minVal(files[i]) : max(files[i]);
+            });
+        }
+        for (auto& t : thrs) {
+            t.join();
+        }
+        doNotOptimize(results);
+    };
+    AsyncFileReader uring, pread(32, 128 * 1024, false);
+    if (!uring.usesUring()) {
+        std::cerr << "io_uring is not available; both readers use pread\n";
+    }
+    auto dropAll = [&] {
+        for (const auto& f : files) {
+            dropPageCache(f);
+        }
+    };
+    const size_t items = requests * perFile;
+    for (const bool cold : {false, true}) {
+        const std::string cache = cold ? "_cold" : "_warm";
+        suite.run("requests_threads" + cache, items, [&] {
+            if (cold) {
+                dropAll();
+            }
+            threadPerRequest();
+        });
+        suite.run("requests_uring" + cache, items, [&] {
+            if (cold) {
+                dropAll();
+            }
+            doNotOptimize(computeAll(files, min2nd, uring));
+        });
+        suite.run("requests_pread" + cache, items, [&] {
+            if (cold) {
+                dropAll();
+            }
+            doNotOptimize(computeAll(files, min2nd, pread));
+        });
+    }
+    return 0;
+}
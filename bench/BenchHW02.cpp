@@ -0,0 +1,71 @@
+// Copyright 2023 Brendan Han
+
+/**
+ * Benchmarks for the hot paths of HW02: loading the passwd and groups
+ * files with storeUid, storeGid, and storeGroups, and listing the
+ * members of a large group with batched lookups (lookupAll) versus one
+ * lookup at a time.  See Bench.h for the command-line options.
+ *
+ * Build (from the top-level directory):
+ *   g++ -std=c++17 -O2 -I. bench/BenchHW02.cpp bench/Bench.cpp -o benchHW02
+ */
+
+#define main hw02_main
+#include "../HW02.cpp"
+#undef main
+#include <random>
+#include "Bench.h"
+
+int main(int argc, char *argv[]) {
+    BenchSuite suite("HW02", argc, argv);
+    const size_t users = suite.scaled(2000000), groups = suite.scaled(200000);
+    const std::string passwd = suite.path("passwd"), groupFile =
+        suite.path("groups");
+    makePasswd(passwd, users);
+    makeGroups(groupFile, groups, users, 20);
+
+    suite.run("storeUid", users, [&] { doNotOptimize(storeUid(passwd)); });
+    suite.run("storeGid", groups, [&] {
+        doNotOptimize(storeGid(groupFile)); });
+    suite.run("storeGroups", groups, [&] {
+        doNotOptimize(storeGroups(groupFile)); });
+
+    // A large group whose members are spread over the whole uid map
+    // (plus a few unknown uids), listed as result() does.
+    const auto uids = storeUid(passwd);
+    const size_t members = suite.scaled(100000);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> dist(0, users + users / 100);
+    std::vector<std::string> keys;
+    std::string memberList;
+    for (size_t i = 0; (i < members); i++) {
+        keys.push_back(std::to_string(1000 + dist(rng)));
+        memberList += (i == 0 ? "" : ",") + keys.back();
+    }
+    suite.run("lookup_one_at_a_time", members, [&] {
+        size_t found = 0;
+        for (const auto& key : keys) {
+            const auto entry = uids.find(key);
+            found += (entry != uids.end()) ? entry->second.size() : 0;
+        }
+        doNotOptimize(found);
+    });
+    suite.run("lookupAll", members, [&] {
+        doNotOptimize(lookupAll(uids, keys)); });
+    // The member listing of result() before lookupAll was added.
+    suite.run("expandMembers_one_at_a_time", members, [&] {
+        std::string users = memberList, ret;
+        std::replace(users.begin(), users.end(), ',', ' ');
+        std::istringstream iss(users);
+        for (std::string sub; iss >> sub;) {
+            const auto entry = uids.find(sub);
+            ret += " ";
+            ret += ((entry != uids.end()) ? entry->second : "") + "(" +
+                sub + ")";
+        }
+        doNotOptimize(ret);
+    });
+    suite.run("expandMembers", members, [&] {
+        doNotOptimize(expandMembers(uids, memberList)); });
+    return 0;
+}
@@ -0,0 +1,50 @@
+// Copyright 2023 Brendan Han
+
+/**
+ * Benchmarks for the hot path of HW03: process, on a synthetic SSH
+ * authentication log, with and without checkpoints.  The log is read
+ * from a file (not downloaded) so that only the processing is timed.
+ * See Bench.h for the command-line options.
+ *
+ * Build (from the top-level directory):
+ *   g++ -std=c++17 -O2 -I. bench/BenchHW03.cpp bench/Bench.cpp -o benchHW03
+ */
+
+#include <unistd.h>
+#define main hw03_main
+#include "../HW03.cpp"
+#undef main
+#include "Bench.h"
+
+int main(int argc, char *argv[]) {
+    BenchSuite suite("HW03", argc, argv);
+    const size_t lines = suite.scaled(1000000);
+    makeAuthLog(suite.path(""), lines);
+    // process loads authorized_users.txt and banned_ips.txt from the
+    // current directory.
+    if (chdir(suite.path("").c_str()) != 0) {
+        throw std::runtime_error("Unable to change to the data directory");
+    }
+
+    // process prints its findings to std::cout; discard them.
+    std::ofstream devNull("/dev/null");
+    suite.run("process", lines, [&] {
+        std::ifstream log("auth.log");
+        std::streambuf* const saved = std::cout.rdbuf(devNull.rdbuf());
+        process(log, devNull);
+        std::cout.rdbuf(saved);
+    });
+
+    // The same with a checkpoint (a small file, synced) every 100k
+    // lines, as a long backfill would run.
+    CheckpointOptions ckpt;
+    ckpt.path       = suite.path("bench_checkpoint");
+    ckpt.everyLines = 100000;
+    suite.run("process_checkpointed", lines, [&] {
+        std::ifstream log("auth.log");
+        std::streambuf* const saved = std::cout.rdbuf(devNull.rdbuf());
+        process(log, devNull, ckpt);
+        std::cout.rdbuf(saved);
+    });
+    return 0;
+}
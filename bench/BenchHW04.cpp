@@ -0,0 +1,123 @@
+// Copyright 2023 Brendan Han
+
+/**
+ * Benchmarks for the hot paths of HW04: starting a child process with
+ * ChildProcess::forkNexec (and spawn, for comparison), from a small
+ * and from a large parent process, and running a PARALLEL script with
+ * JobScheduler, with and without an OutputCache holding the output of
+ * every job, and one job at a time versus several (the makespan).  See
+ * Bench.h for the command-line options.
+ *
+ * Build (from the top-level directory):
+ *   g++ -std=c++17 -O2 -I. -IHW04 bench/BenchHW04.cpp bench/Bench.cpp \
+ *       HW04/ChildProcess.cpp HW04/JobScheduler.cpp HW04/Pipeline.cpp \
+ *       HW04/UsageReport.cpp HW04/OutputCache.cpp -o benchHW04
+ */
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "ChildProcess.h"
+#include "JobScheduler.h"
+#include "OutputCache.h"
+#include "Bench.h"
+
+int main(int argc, char *argv[]) {
+    BenchSuite suite("HW04", argc, argv);
+    const size_t procs = suite.scaled(200);
+    const StrVec cmd = {"true"};
+
+    suite.run("forkNexec", procs, [&] {
+        for (size_t i = 0; (i < procs); i++) {
+            ChildProcess child;
+            child.forkNexec(cmd);
+            child.wait();
+        }
+    });
+    suite.run("spawn", procs, [&] {
+        for (size_t i = 0; (i < procs); i++) {
+            ChildProcess child;
+            child.spawn(cmd);
+            child.wait();
+        }
+    });
+
+    // The same from a large parent (512 MiB touched at scale 1), whose
+    // page tables fork must copy but spawn (vfork-style) does not.
+    {
+        const size_t bytes = suite.scaled(512) << 20;
+        const std::vector<char> ballast(bytes, 1);
+        const std::string size = std::to_string(bytes >> 20) + "MiB";
+        suite.run("forkNexec_" + size, procs, [&] {
+            for (size_t i = 0; (i < procs); i++) {
+                ChildProcess child;
+                child.forkNexec(cmd);
+                child.wait();
+            }
+        });
+        suite.run("spawn_" + size, procs, [&] {
+            for (size_t i = 0; (i < procs); i++) {
+                ChildProcess child;
+                child.spawn(cmd);
+                child.wait();
+            }
+        });
+        doNotOptimize(ballast.data());
+    }
+
+    // A dependency graph of short jobs, as a PARALLEL script would run.
+    const size_t jobs = suite.scaled(200);
+    const std::string script = suite.path("bench_script.txt");
+    makeScript(script, jobs, "true");
+    const int maxJobs = std::max(1U, std::thread::hardware_concurrency());
+    auto runScript = [&](const std::string& path, OutputCache* cache,
+                         const int jobLimit) {
+        JobScheduler sched(jobLimit);
+        std::ifstream is(path);
+        for (std::string line; std::getline(is, line);) {
+            Job job;
+            if (JobScheduler::parseJob(line, job)) {
+                sched.add(job);
+            }
+        }
+        std::ostringstream out;
+        sched.run(out, nullptr, cache);
+    };
+    suite.run("JobScheduler", jobs, [&] {
+        runScript(script, nullptr, maxJobs);
+    });
+
+    // The makespan of a script of short waits (as for I/O-bound
+    // commands) run one job at a time versus several at a time.
+    const size_t waits = suite.scaled(40);
+    const std::string waitScript = suite.path("bench_sleep.txt");
+    makeScript(waitScript, waits, "sleep 0.02");
+    const int waitJobs = std::max(8, maxJobs);
+    suite.run("makespan_serial", waits, [&] {
+        runScript(waitScript, nullptr, 1);
+    });
+    const double serialMs = suite.last().medianMs;
+    suite.run("makespan_" + std::to_string(waitJobs) + "jobs", waits, [&] {
+        runScript(waitScript, nullptr, waitJobs);
+    });
+    suite.addMetric("speedup_vs_serial", serialMs / suite.last().medianMs);
+
+    // The same script with every job declared cacheable, replayed from
+    // a cache that was filled by one untimed run.
+    const std::string cachedScript = suite.path("bench_cached.txt");
+    {
+        std::ifstream is(script);
+        std::ofstream os(cachedScript);
+        for (std::string line; std::getline(is, line);) {
+            const size_t run = line.find(" RUN ");
+            os << line.insert(run, " INPUTS") << '\n';
+        }
+    }
+    OutputCache cache(suite.path("bench_cache"));
+    runScript(cachedScript, &cache, maxJobs);
+    suite.run("JobScheduler_cached", jobs, [&] {
+        runScript(cachedScript, &cache, maxJobs);
+    });
+    return 0;
+}
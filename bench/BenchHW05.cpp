@@ -0,0 +1,259 @@
+// Copyright 2023 Brendan Han
+
+/**
+ * Benchmarks for the hot paths of HW05: factorize on batches of
+ * semiprimes of increasing size and on numbers of 128 to 512 bits,
+ * primeFactors versus the trial division of hw5.h on 64-bit
+ * semiprimes, the allocations made formatting results (counted by
+ * replacing the global operator new), the thread pool versus a thread
+ * per number on mixed easy and hard inputs, worker processes
+ * (FactorFanOut) versus the pool, and get2ndMax from 1 to N threads.
+ * See Bench.h for the command-line options.
+ *
+ * Build (from the top-level directory):
+ *   g++ -std=c++17 -O2 -I. bench/BenchHW05.cpp bench/Bench.cpp HW05.cpp \
+ *       Factorization.cpp PrimeSieve.cpp ThreadPool.cpp FactorFanOut.cpp \
+ *       HW04/ChildProcess.cpp Metrics.cpp -pthread -o benchHW05
+ */
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "hw5.h"
+#include "FactorFanOut.h"
+#include "Factorization.h"
+#include "ThreadPool.h"
+#include "WideInt.h"
+#include "Bench.h"
+
+StrVec factorize(const BigIntVec& numVec);
+StrVec factorize(const StrVec& numStrs);
+void factorize(const BigIntVec& numVec, std::ostream& os);
+void factorize(std::istream& is, std::ostream& os, const size_t batchSize,
+               size_t maxInFlight);
+
+namespace {
+/** The number of calls to operator new, for the allocation counts. */
+std::atomic<size_t> allocCount(0);
+}  // namespace
+
+// Counting replacements for the global operator new and delete (the
+// array and nothrow forms call these).
+void* operator new(size_t size) {
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    void* const ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+BigInt get2ndMax(const BigIntVec& numList, const int thrCount);
+
+int main(int argc, char *argv[]) {
+    // This program is also the worker for the fan-out benchmark.
+    if (argc == 3 && std::string(argv[1]) == "--fanout-worker") {
+        std::ios_base::sync_with_stdio(false);
+        factorize(std::cin, std::cout, std::stoul(argv[2]), 0);
+        return 0;
+    }
+    BenchSuite suite("HW05", argc, argv);
+    // Fewer numbers as they get harder, so each batch takes similar time.
+    for (const auto& sizes : {std::make_pair(32, 100000),
+                              std::make_pair(48, 20000),
+                              std::make_pair(62, 2000)}) {
+        const std::vector<uint64_t> primes =
+            makeSemiprimes(suite.scaled(sizes.second), sizes.first);
+        const BigIntVec nums(primes.begin(), primes.end());
+        suite.run("factorize_" + std::to_string(sizes.first) + "bit",
+                  nums.size(), [&] { doNotOptimize(factorize(nums)); });
+    }
+
+    // The allocations made while formatting results, one string per
+    // number (StrVec) versus straight into a stream, on easy numbers
+    // (8 to 40 bits) so that formatting dominates.
+    std::mt19937_64 easyRng(36);
+    BigIntVec easy(suite.scaled(1000000));
+    for (auto& num : easy) {
+        num = (easyRng() >> (24 + easyRng() % 32)) + 2;
+    }
+    std::ofstream devNull("/dev/null");
+    auto addAllocs = [&](const size_t before) {  // Per run, incl. warm-up
+        const double perRun = double(allocCount - before) / (suite.reps() + 1);
+        suite.addMetric("allocs_per_run", perRun);
+        suite.addMetric("allocs_per_number", perRun / easy.size());
+    };
+    size_t allocsBefore = allocCount;
+    suite.run("format_strvec", easy.size(), [&] {
+        doNotOptimize(factorize(easy)); });
+    addAllocs(allocsBefore);
+    allocsBefore = allocCount;
+    suite.run("format_stream", easy.size(), [&] {
+        factorize(easy, devNull); });
+    addAllocs(allocsBefore);
+
+    // Random 64-bit semiprimes factored by primeFactors (Miller-Rabin
+    // and Pollard-Brent) versus the hw5.h path it replaced: isPrime,
+    // factorize (the smallest factor, by trial division), and isPrime
+    // of the cofactor.  The smaller prime has 16 to 28 bits so that
+    // trial division finishes in seconds; the engine alone also gets
+    // the same kind of numbers in bulk.
+    std::mt19937_64 semiRng(32);
+    auto randomPrime = [&](const int bits) {
+        const uint64_t top = 1ULL << (bits - 1);
+        uint64_t p = (semiRng() & (top - 1)) | top | 1;
+        while (!isPrime64(p)) {
+            p += 2;
+        }
+        return p;
+    };
+    BigIntVec semis(suite.scaled(20000));
+    for (auto& num : semis) {
+        const int bits = 16 + semiRng() % 13;
+        num = randomPrime(bits) * randomPrime(64 - bits);
+    }
+    const size_t hw5Count = std::min(semis.size(), suite.scaled(8));
+    suite.run("semiprime64_hw5", hw5Count, [&] {
+        for (size_t i = 0; (i < hw5Count); i++) {
+            const BigInt smallest = factorize(semis[i]);
+            doNotOptimize(isPrime(semis[i]) + isPrime(semis[i] / smallest));
+        }
+    });
+    const double hw5PerNumMs = suite.last().medianMs / hw5Count;
+    suite.run("semiprime64_primeFactors", semis.size(), [&] {
+        uint64_t factors[MaxFactors];
+        for (const BigInt num : semis) {
+            doNotOptimize(primeFactors(num, factors));
+        }
+    });
+    suite.addMetric("speedup_vs_hw5",
+                    hw5PerNumMs * semis.size() / suite.last().medianMs);
+
+    // Numbers wider than 64 bits (as decimal strings), each a product
+    // of 32-bit primes, so that rho and ECM find every factor.
+    std::mt19937_64 wideRng(37);
+    for (const auto& sizes : {std::make_pair(128, 100),
+                              std::make_pair(256, 20),
+                              std::make_pair(512, 4)}) {
+        StrVec nums;
+        for (size_t i = 0; (i < suite.scaled(sizes.second)); i++) {
+            WideUInt<8> num(1);
+            for (int bits = 0; (bits < sizes.first); bits += 32) {
+                uint64_t p = (wideRng() >> 32) | (1ULL << 31) | 1;
+                while (!isPrime64(p)) {
+                    p += 2;
+                }
+                num *= p;
+            }
+            nums.push_back(num.toString());
+        }
+        suite.run("factorize_wide_" + std::to_string(sizes.first) + "bit",
+                  nums.size(), [&] { doNotOptimize(factorize(nums)); });
+    }
+
+    // A mix of easy numbers and (one in 16) hard 62-bit semiprimes,
+    // factored by the pool (whose workers steal from each other) and
+    // by one thread per number (as factorize did before the pool).
+    // The completion time of each number is recorded for the tail.
+    using Clock = std::chrono::steady_clock;
+    std::mt19937_64 mixRng(31);
+    BigIntVec mixed;
+    for (const uint64_t hard : makeSemiprimes(suite.scaled(1000), 62)) {
+        mixed.push_back(hard);
+        for (int i = 0; (i < 15); i++) {
+            mixed.push_back(mixRng() >> 24);
+        }
+    }
+    std::shuffle(mixed.begin(), mixed.end(), mixRng);
+    std::vector<double> doneMs(mixed.size());
+    auto factorOne = [&](const size_t i, const Clock::time_point start) {
+        uint64_t factors[MaxFactors];
+        doNotOptimize(primeFactors(mixed[i], factors));
+        doneMs[i] = std::chrono::duration<double, std::milli>(
+            Clock::now() - start).count();
+    };
+    auto addTail = [&] {  // Of the last run
+        suite.addMetric("p50_done_ms", percentile(doneMs, 0.5));
+        suite.addMetric("p99_done_ms", percentile(doneMs, 0.99));
+        suite.addMetric("max_done_ms", percentile(doneMs, 1));
+    };
+    suite.run("mixed_pool", mixed.size(), [&] {
+        const auto start = Clock::now();
+        ThreadPool::instance().parallelFor(mixed.size(), 1,
+            [&](const size_t begin, const size_t end) {
+                for (size_t i = begin; (i < end); i++) {
+                    factorOne(i, start);
+                }
+            });
+    });
+    addTail();
+    suite.run("mixed_thread_per_item", mixed.size(), [&] {
+        const auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (size_t i = 0; (i < mixed.size()); i++) {
+            threads.emplace_back(factorOne, i, start);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    });
+    addTail();
+
+    // Streaming a batch through worker processes (FactorFanOut, one
+    // per CPU) versus through this process's pool.
+    std::string numText;
+    for (const uint64_t num : makeSemiprimes(suite.scaled(20000), 48)) {
+        numText += std::to_string(num) + '\n';
+    }
+    suite.run("stream_pool", suite.scaled(20000), [&] {
+        std::istringstream is(numText);
+        factorize(is, devNull, 4096, 0);
+    });
+    const double poolMs = suite.last().medianMs;
+    char self[PATH_MAX];
+    const ssize_t selfLen = readlink("/proc/self/exe", self, sizeof(self));
+    const StrVec workerCmd = {std::string(self, std::max<ssize_t>(0, selfLen)),
+                              "--fanout-worker"};
+    const int workers = std::max(1U, std::thread::hardware_concurrency());
+    suite.run("fanout_vs_pool", suite.scaled(20000), [&] {
+        std::istringstream is(numText);
+        FactorFanOut(workerCmd, workers).run(is, devNull, 4096);
+    });
+    suite.addMetric("workers", workers);
+    suite.addMetric("pool_median_ms", poolMs);
+    suite.addMetric("speedup_vs_pool", poolMs / suite.last().medianMs);
+
+    // get2ndMax from 1 to N threads (doubling, and N itself) on 1e9
+    // values at scale 1, which needs 8 GB of memory; use --scale 0.1
+    // or less on smaller machines.
+    std::mt19937_64 rng(381);
+    BigIntVec values(suite.scaled(1000000000));
+    for (auto& v : values) {
+        v = rng();
+    }
+    const int maxThreads = std::max(1U, std::thread::hardware_concurrency());
+    for (int thrCount = 1;; thrCount = std::min(2 * thrCount, maxThreads)) {
+        suite.run("get2ndMax_" + std::to_string(thrCount) + "thr",
+                  values.size(), [&] {
+                      doNotOptimize(get2ndMax(values, thrCount)); });
+        if (thrCount == maxThreads) {
+            break;
+        }
+    }
+    return 0;
+}